@@ -0,0 +1,89 @@
+#include "arena.h"
+
+#define INIT_ARENA_SIZE (16 << 10)
+// a reset keeps at most this much, a longer line gives its memory back
+#define MAX_KEPT_ARENA_SIZE (64 << 10)
+#define ARENA_ALIGN 16
+
+/* private global var */
+ArenaBlock *cur_block = NULL;
+// size of all blocks in the chain
+size_t arena_size = 0;
+
+
+ArenaBlock *new_block(size_t size, ArenaBlock *prev) {
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    if(!block) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    block->prev = prev;
+    block->size = size;
+    block->used = 0;
+    arena_size += size;
+    return block;
+}
+
+size_t align_up(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+
+/* public function */
+void *arena_alloc(size_t size) {
+    size = align_up(size);
+    if(!cur_block) {
+        cur_block = new_block(INIT_ARENA_SIZE, NULL);
+    }
+    if(cur_block->size - cur_block->used < size) {
+        size_t block_size = cur_block->size * 2;
+        while(block_size < size) {
+            block_size *= 2;
+        }
+        cur_block = new_block(block_size, cur_block);
+    }
+    void *ptr = cur_block->data + cur_block->used;
+    cur_block->used += size;
+    return memset(ptr, 0, size);
+}
+
+void *arena_grow(void *ptr, size_t old_size, size_t new_size) {
+    old_size = align_up(old_size);
+    new_size = align_up(new_size);
+    // the last allocation can just take more of its block
+    if(cur_block && (char *)ptr + old_size == cur_block->data + cur_block->used
+       && cur_block->size - cur_block->used >= new_size - old_size) {
+        memset((char *)ptr + old_size, 0, new_size - old_size);
+        cur_block->used += new_size - old_size;
+        return ptr;
+    }
+    void *new_ptr = arena_alloc(new_size);
+    if(ptr) {
+        memcpy(new_ptr, ptr, old_size);
+    }
+    return new_ptr;
+}
+
+char *arena_strdup(const char *str) {
+    size_t len = strlen(str) + 1;
+    return memcpy(arena_alloc(len), str, len);
+}
+
+/* give back everything of the last command line */
+void reset_arena() {
+    if(!cur_block) {
+        return;
+    }
+    if(cur_block->prev) {
+        // the line needed a chain, keep one block that holds it all unless it's huge
+        size_t size = arena_size <= MAX_KEPT_ARENA_SIZE ? arena_size : INIT_ARENA_SIZE;
+        while(cur_block) {
+            ArenaBlock *prev = cur_block->prev;
+            free(cur_block);
+            cur_block = prev;
+        }
+        arena_size = 0;
+        cur_block = new_block(size, NULL);
+    }
+    cur_block->used = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+/*
+    memory of one command line: tokens, words, nodes and arg vectors are
+    cut from one block and all given back by reset_arena once the line
+    ran. a line that doesn't fit chains more blocks, the reset then makes
+    one block as big as all of them, so the next such line does no malloc.
+    past 64 KB it goes back to the first block size instead, one very long
+    line doesn't keep its memory for the rest of a script.
+*/
+
+typedef struct ArenaBlock ArenaBlock;
+struct ArenaBlock {
+    ArenaBlock *prev;
+    size_t size, used;
+    char data[];
+};
+
+// zeroed like calloc
+void *arena_alloc(size_t size);
+// in place when ptr is the last thing allocated, else a zeroed copy
+void *arena_grow(void *ptr, size_t old_size, size_t new_size);
+char *arena_strdup(const char *str);
+void reset_arena();
+
+#endif
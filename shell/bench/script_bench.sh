@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+#   lines per second running one generated script, ash against bash and dash
+#
+#   script_bench.sh [-b] [-n lines] [ash]
+#
+#   every group of four lines is a command, a pipeline, a comment and a
+#   blank line, so half the lines start a process and half only go through
+#   the scanner. commands have a full path, bash and dash would run their
+#   own builtin true and echo otherwise.
+#
+#   with -b every line is a builtin instead: true, test and echo, printf
+#   and pwd, none of them should start a process.
+
+lines=100000
+builtin=0
+if [ "$1" = "-b" ]; then
+    builtin=1
+    shift
+fi
+if [ "$1" = "-n" ]; then
+    lines=$2
+    shift 2
+fi
+ash=${1:-./ash}
+
+script=$(mktemp /tmp/script_bench.XXXXXX)
+trap 'rm -f "$script"' EXIT
+awk -v n="$lines" -v b="$builtin" 'BEGIN {
+    for(i = 0; i < n; i++) {
+        if(b) {
+            if(i % 4 == 0) print "true"
+            else if(i % 4 == 1) print "test -n line" i " && echo line " i
+            else if(i % 4 == 2) print "printf \"%s %d\\n\" line " i
+            else print "pwd"
+        }
+        else if(i % 4 == 0) print "/bin/true"
+        else if(i % 4 == 1) print "/bin/echo line " i " | /bin/cat"
+        else if(i % 4 == 2) print "# comment " i
+        else print ""
+    }
+}' > "$script"
+
+[ $builtin = 1 ] && echo "$lines lines of builtins" || echo "$lines lines"
+for sh in "$ash" bash dash; do
+    if ! command -v "$sh" > /dev/null; then
+        printf "  %-12s %10s\n" "$sh" "not found"
+        continue
+    fi
+    start=$(date +%s.%N)
+    "$sh" "$script" > /dev/null
+    end=$(date +%s.%N)
+    awk -v sh="$sh" -v n="$lines" -v s="$start" -v e="$end" \
+        'BEGIN { printf "  %-12s %10.0f lines/s\n", sh, n / (e - s) }'
+done
@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/wait.h>
+
+/*
+    commands per second, fork + execve against posix_spawn
+
+    spawn_bench [-n count] [-m heap_mb] [ash]
+
+    the bench touches heap_mb of heap first, fork has to copy the page
+    tables of all of it for every command, posix_spawn does not. with ash
+    given, count lines of "/bin/true" are also fed to it as a script, which
+    is what a build script firing short commands looks like. the full path
+    keeps ash from running its builtin true, which starts no process.
+*/
+
+#define DEFAULT_COUNT 5000
+#define COMMAND "/bin/true"
+
+extern char **environ;
+
+double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double run_fork(int count) {
+    char *argv[] = {COMMAND, NULL};
+    double start = now_sec();
+    for(int i = 0; i < count; i++) {
+        pid_t pid = fork();
+        if(pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if(pid == 0) {
+            execve(COMMAND, argv, environ);
+            _exit(127);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return count / (now_sec() - start);
+}
+
+double run_spawn(int count) {
+    char *argv[] = {COMMAND, NULL};
+    double start = now_sec();
+    for(int i = 0; i < count; i++) {
+        pid_t pid;
+        if(posix_spawn(&pid, COMMAND, NULL, NULL, argv, environ) != 0) {
+            perror("posix_spawn");
+            exit(1);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return count / (now_sec() - start);
+}
+
+/* count lines of "/bin/true" through ash, stdin is the script and stdout goes nowhere */
+double run_ash(const char *ash, int count) {
+    char path[] = "/tmp/spawn_bench.XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    unlink(path);
+    FILE *script = fdopen(fd, "w+");
+    for(int i = 0; i < count; i++) {
+        fputs(COMMAND "\n", script);
+    }
+    fflush(script);
+    lseek(fd, 0, SEEK_SET);
+
+    double start = now_sec();
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if(pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        execl(ash, ash, (char *)NULL);
+        perror(ash);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+    double rate = count / (now_sec() - start);
+    fclose(script);
+    return rate;
+}
+
+int main(int argc, char *argv[]) {
+    int count = DEFAULT_COUNT;
+    size_t heap_mb = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "n:m:")) != -1) {
+        switch(opt) {
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 'm':
+                heap_mb = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n count] [-m heap_mb] [ash]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if(count < 1) {
+        fprintf(stderr, "spawn_bench: invalid count\n");
+        exit(1);
+    }
+
+    // a big heap that is really mapped, like a shell holding a lot of state
+    char *heap = NULL;
+    if(heap_mb) {
+        heap = malloc(heap_mb << 20);
+        if(!heap) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        memset(heap, 1, heap_mb << 20);
+    }
+
+    printf("%d commands, %zu MB heap\n", count, heap_mb);
+    printf("  %-12s %10.0f cmd/s\n", "fork", run_fork(count));
+    printf("  %-12s %10.0f cmd/s\n", "posix_spawn", run_spawn(count));
+    if(optind < argc) {
+        printf("  %-12s %10.0f cmd/s\n", "ash", run_ash(argv[optind], count));
+    }
+    free(heap);
+}
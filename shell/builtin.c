@@ -0,0 +1,595 @@
+#include "builtin.h"
+#include "interactive.h"
+#include "hash.h"
+#include "jobs.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern int LAST_STATUS;
+
+typedef struct Builtin Builtin;
+struct Builtin {
+    const char *name;
+    BuiltinFunc func;
+};
+
+/* private global var */
+// test: the operands and the one looked at
+char **test_argv;
+int test_argc, test_pos;
+// a syntax error or a bad number, test returns 2
+bool test_error;
+
+
+/* shell state */
+
+int exit_builtin(int argc, char **argv) {
+    exit(argc > 1 ? atoi(argv[1]) : LAST_STATUS);
+}
+
+int cd_builtin(int argc, char **argv) {
+    char *direction = argc > 1 ? argv[1] : (char *)home_dir();
+    if(chdir(direction) != 0) {
+        printf("cd: no such file or directory: %s\n", direction);
+        return 1;
+    }
+    update_cwd();
+    return 0;
+}
+
+int pwd_builtin(int argc, char **argv) {
+    puts(cur_dir());
+    return 0;
+}
+
+int true_builtin(int argc, char **argv) {
+    return 0;
+}
+
+int false_builtin(int argc, char **argv) {
+    return 1;
+}
+
+
+/* echo and printf */
+
+/*
+    write str with its backslash escapes, \0nnn for an octal byte when
+    zero_octal is set (echo -e, %b), \nnn otherwise (the printf format).
+    true once \c said to stop all output.
+*/
+bool put_escaped(const char *str, bool zero_octal) {
+    for(; *str; str++) {
+        if(*str != '\\' || !str[1]) {
+            putchar(*str);
+            continue;
+        }
+        str++;
+        switch(*str) {
+            case 'a': putchar('\a'); break;
+            case 'b': putchar('\b'); break;
+            case 'c': return true;
+            case 'e': putchar('\033'); break;
+            case 'f': putchar('\f'); break;
+            case 'n': putchar('\n'); break;
+            case 'r': putchar('\r'); break;
+            case 't': putchar('\t'); break;
+            case 'v': putchar('\v'); break;
+            case '\\': putchar('\\'); break;
+            default:
+                if(*str >= '0' && *str <= '7') {
+                    // at most three digits after the \0 or the \ itself
+                    const char *digit = str + (zero_octal && *str == '0');
+                    int value = 0, len = 0;
+                    for(; len < 3 && *digit >= '0' && *digit <= '7'; len++, digit++) {
+                        value = value * 8 + (*digit - '0');
+                    }
+                    putchar(value);
+                    str = digit - 1;
+                } else {
+                    putchar('\\');
+                    putchar(*str);
+                }
+        }
+    }
+    return false;
+}
+
+/* echo [-neE] word..., like coreutils echo */
+int echo_builtin(int argc, char **argv) {
+    bool newline = true, escape = false;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        const char *opt = argv[i] + 1;
+        // anything else than these is a word
+        if(strspn(opt, "neE") != strlen(opt)) {
+            break;
+        }
+        for(; *opt; opt++) {
+            if(*opt == 'n') {
+                newline = false;
+            } else {
+                escape = *opt == 'e';
+            }
+        }
+    }
+    for(; i < argc; i++) {
+        if(escape) {
+            if(put_escaped(argv[i], true)) {
+                return 0;
+            }
+        } else {
+            fputs(argv[i], stdout);
+        }
+        if(i + 1 < argc) {
+            putchar(' ');
+        }
+    }
+    if(newline) {
+        putchar('\n');
+    }
+    return 0;
+}
+
+/* a number operand of printf, 'c or "c is the code of c */
+bool printf_number(const char *arg, bool is_signed, long long *value) {
+    if(!arg) {
+        *value = 0;
+        return true;
+    }
+    if(arg[0] == '\'' || arg[0] == '"') {
+        *value = (unsigned char)arg[1];
+        return true;
+    }
+    char *end;
+    errno = 0;
+    *value = is_signed ? strtoll(arg, &end, 0) : (long long)strtoull(arg, &end, 0);
+    if(end == arg || *end || errno) {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        return false;
+    }
+    return true;
+}
+
+/*
+    one pass over the format, the operands it uses are taken from *args.
+    true once output has to stop, for \c or an invalid directive.
+*/
+bool print_format(const char *format, char ***args, int *status) {
+    for(const char *cur = format; *cur; cur++) {
+        if(*cur == '\\') {
+            // one escape at a time, so \c can stop right here
+            char escape[5] = {'\\', 0};
+            size_t len = 1 + (cur[1] != 0);
+            if(cur[1] >= '0' && cur[1] <= '7') {
+                len = 1 + strspn(cur + 1, "01234567");
+                len = len > 4 ? 4 : len;
+            }
+            memcpy(escape, cur, len);
+            if(put_escaped(escape, false)) {
+                return true;
+            }
+            cur += len - 1;
+            continue;
+        }
+        if(*cur != '%') {
+            putchar(*cur);
+            continue;
+        }
+        if(cur[1] == '%') {
+            putchar('%');
+            cur++;
+            continue;
+        }
+        // %[flags][width][.precision]conversion, with ll put in for integers
+        char spec[64] = "%";
+        size_t len = 1 + strspn(cur + 1, "-+ #0");
+        len += strspn(cur + len, "0123456789");
+        if(cur[len] == '.') {
+            len += 1 + strspn(cur + len + 1, "0123456789");
+        }
+        char conv = cur[len];
+        if(!conv || !strchr("sbcdiouxXeEfFgGaA", conv) || len + 3 >= sizeof(spec)) {
+            fprintf(stderr, "printf: %.*s: invalid directive\n", (int)len + (conv != 0), cur);
+            *status = 1;
+            return true;
+        }
+        memcpy(spec, cur, len);
+        spec[len] = 0;
+        const char *arg = **args;
+        if(arg) {
+            (*args)++;
+        }
+        long long value = 0;
+        if(conv == 's' || conv == 'c') {
+            // %c of an empty operand writes nothing
+            if(conv == 'c' && (!arg || !arg[0])) {
+                cur += len;
+                continue;
+            }
+            strcat(spec, conv == 's' ? "s" : "c");
+            if(conv == 's') {
+                printf(spec, arg ? arg : "");
+            } else {
+                printf(spec, arg[0]);
+            }
+        } else if(conv == 'b') {
+            if(arg && put_escaped(arg, true)) {
+                return true;
+            }
+        } else if(strchr("eEfFgGaA", conv)) {
+            char *end = NULL;
+            double real = arg ? strtod(arg, &end) : 0;
+            if(arg && (end == arg || *end)) {
+                fprintf(stderr, "printf: %s: invalid number\n", arg);
+                *status = 1;
+            }
+            spec[len] = conv;
+            spec[len + 1] = 0;
+            printf(spec, real);
+        } else {
+            if(!printf_number(arg, conv == 'd' || conv == 'i', &value)) {
+                *status = 1;
+            }
+            spec[len] = 'l';
+            spec[len + 1] = 'l';
+            spec[len + 2] = conv;
+            spec[len + 3] = 0;
+            printf(spec, value);
+        }
+        cur += len;
+    }
+    return false;
+}
+
+/* printf format [operand...], the format is used again while operands are left */
+int printf_builtin(int argc, char **argv) {
+    if(argc < 2) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    char **args = argv + 2;
+    int status = 0;
+    while(true) {
+        char **before = args;
+        if(print_format(argv[1], &args, &status)) {
+            break;
+        }
+        // done, or the format takes no operands and would go on forever
+        if(!*args || args == before) {
+            break;
+        }
+    }
+    return status;
+}
+
+
+/* test and [ */
+
+bool is_binary_op(const char *op) {
+    static const char *ops[] = {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL
+    };
+    for(int i = 0; ops[i]; i++) {
+        if(strcmp(op, ops[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool is_unary_op(const char *op) {
+    return op[0] == '-' && op[1] && !op[2] && strchr("bcdefghLkprsStuwxnz", op[1]);
+}
+
+long long test_number(const char *arg) {
+    char *end;
+    errno = 0;
+    long long value = strtoll(arg, &end, 10);
+    while(isspace((unsigned char)*end)) {
+        end++;
+    }
+    if(end == arg || *end || errno) {
+        fprintf(stderr, "test: %s: integer expression expected\n", arg);
+        test_error = true;
+    }
+    return value;
+}
+
+bool test_unary(char op, const char *arg) {
+    struct stat st;
+    switch(op) {
+        case 'n': return arg[0];
+        case 'z': return !arg[0];
+        case 't': return isatty(test_number(arg));
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+        case 'h':
+        case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    }
+    if(stat(arg, &st) != 0) {
+        return false;
+    }
+    switch(op) {
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'f': return S_ISREG(st.st_mode);
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 'g': return st.st_mode & S_ISGID;
+        case 'u': return st.st_mode & S_ISUID;
+        case 'k': return st.st_mode & S_ISVTX;
+        case 's': return st.st_size > 0;
+    }
+    // -e
+    return true;
+}
+
+bool test_binary(const char *left, const char *op, const char *right) {
+    if(strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+        return strcmp(left, right) == 0;
+    } else if(strcmp(op, "!=") == 0) {
+        return strcmp(left, right) != 0;
+    } else if(strcmp(op, "<") == 0) {
+        return strcmp(left, right) < 0;
+    } else if(strcmp(op, ">") == 0) {
+        return strcmp(left, right) > 0;
+    }
+    if(op[1] == 'n' || op[1] == 'o' || strcmp(op, "-ef") == 0) {
+        struct stat left_st, right_st;
+        bool has_left = stat(left, &left_st) == 0, has_right = stat(right, &right_st) == 0;
+        if(strcmp(op, "-ef") == 0) {
+            return has_left && has_right && left_st.st_dev == right_st.st_dev
+                   && left_st.st_ino == right_st.st_ino;
+        }
+        // a missing file is older than any other
+        if(op[1] == 'o') {
+            const char *tmp = left;
+            left = right;
+            right = tmp;
+            bool has_tmp = has_left;
+            has_left = has_right;
+            has_right = has_tmp;
+            struct stat tmp_st = left_st;
+            left_st = right_st;
+            right_st = tmp_st;
+        }
+        if(!has_left) {
+            return false;
+        }
+        if(!has_right) {
+            return true;
+        }
+        return left_st.st_mtim.tv_sec > right_st.st_mtim.tv_sec
+               || (left_st.st_mtim.tv_sec == right_st.st_mtim.tv_sec
+                   && left_st.st_mtim.tv_nsec > right_st.st_mtim.tv_nsec);
+    }
+    long long a = test_number(left), b = test_number(right);
+    if(strcmp(op, "-eq") == 0) return a == b;
+    if(strcmp(op, "-ne") == 0) return a != b;
+    if(strcmp(op, "-lt") == 0) return a < b;
+    if(strcmp(op, "-le") == 0) return a <= b;
+    if(strcmp(op, "-gt") == 0) return a > b;
+    return a >= b;
+}
+
+bool test_or();
+
+/* ( expr ), unary, binary or a lone string, operand count decides like POSIX */
+bool test_primary() {
+    int left = test_argc - test_pos;
+    if(left <= 0) {
+        fprintf(stderr, "test: argument expected\n");
+        test_error = true;
+        return false;
+    }
+    char **arg = test_argv + test_pos;
+    if(left >= 3 && is_binary_op(arg[1])) {
+        test_pos += 3;
+        return test_binary(arg[0], arg[1], arg[2]);
+    }
+    if(left >= 2 && is_unary_op(arg[0])) {
+        test_pos += 2;
+        return test_unary(arg[0][1], arg[1]);
+    }
+    if(left >= 3 && strcmp(arg[0], "(") == 0) {
+        test_pos++;
+        bool value = test_or();
+        if(test_pos >= test_argc || strcmp(test_argv[test_pos], ")") != 0) {
+            fprintf(stderr, "test: ')' expected\n");
+            test_error = true;
+        }
+        test_pos++;
+        return value;
+    }
+    test_pos++;
+    return arg[0][0];
+}
+
+bool test_not() {
+    // with three operands "! = x" compares the string !
+    if(test_pos < test_argc && strcmp(test_argv[test_pos], "!") == 0
+       && !(test_argc - test_pos == 3 && is_binary_op(test_argv[test_pos + 1]))
+       && test_argc - test_pos > 1) {
+        test_pos++;
+        return !test_not();
+    }
+    return test_primary();
+}
+
+bool test_and() {
+    bool value = test_not();
+    while(test_pos < test_argc && strcmp(test_argv[test_pos], "-a") == 0) {
+        test_pos++;
+        // both sides are parsed, only the value short-circuits
+        value = test_not() && value;
+    }
+    return value;
+}
+
+bool test_or() {
+    bool value = test_and();
+    while(test_pos < test_argc && strcmp(test_argv[test_pos], "-o") == 0) {
+        test_pos++;
+        value = test_and() || value;
+    }
+    return value;
+}
+
+/* test expr, or [ expr ] */
+int test_builtin(int argc, char **argv) {
+    if(strcmp(argv[0], "[") == 0) {
+        if(strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+    test_argv = argv + 1;
+    test_argc = argc - 1;
+    test_pos = 0;
+    test_error = false;
+    // no operands is false
+    bool value = test_argc && test_or();
+    if(!test_error && test_pos < test_argc) {
+        fprintf(stderr, "test: %s: unexpected operator\n", test_argv[test_pos]);
+        test_error = true;
+    }
+    return test_error ? 2 : !value;
+}
+
+
+/* read */
+
+/*
+    read [-r] [name...]: one line of stdin split at $IFS, the last name
+    takes the rest. the values are exported like everything else ash
+    keeps, a name without any is REPLY.
+*/
+int read_builtin(int argc, char **argv) {
+    int i = 1;
+    bool raw = i < argc && strcmp(argv[i], "-r") == 0;
+    i += raw;
+    // a prompt written with printf shows before read blocks
+    fflush(stdout);
+
+    size_t len = 0, cap = 128;
+    // a backslash makes the next char part of a field
+    char *line = malloc(cap), *escaped = malloc(cap);
+    if(!line || !escaped) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    bool got_line = false;
+    while(true) {
+        // one byte at a time, what follows the line is for the next reader
+        char c;
+        ssize_t n = read(STDIN_FILENO, &c, 1);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            break;
+        }
+        bool is_escaped = false;
+        if(c == '\\' && !raw) {
+            while((n = read(STDIN_FILENO, &c, 1)) < 0 && errno == EINTR) {
+            }
+            if(n <= 0) {
+                break;
+            }
+            // a line continuation
+            if(c == '\n') {
+                continue;
+            }
+            is_escaped = true;
+        } else if(c == '\n') {
+            got_line = true;
+            break;
+        }
+        if(len + 1 >= cap) {
+            cap *= 2;
+            line = realloc(line, cap);
+            escaped = realloc(escaped, cap);
+            if(!line || !escaped) {
+                perror("Memory leak!");
+                exit(1);
+            }
+        }
+        escaped[len] = is_escaped;
+        line[len++] = c;
+    }
+    line[len] = 0;
+
+    if(i >= argc) {
+        setenv("REPLY", line, 1);
+    } else {
+        const char *ifs = getenv("IFS");
+        if(!ifs) {
+            ifs = " \t\n";
+        }
+        size_t pos = 0;
+        for(; i < argc; i++) {
+            // fields are split at runs of $IFS chars
+            while(pos < len && !escaped[pos] && strchr(ifs, line[pos])) {
+                pos++;
+            }
+            size_t start = pos;
+            if(i + 1 < argc) {
+                while(pos < len && (escaped[pos] || !strchr(ifs, line[pos]))) {
+                    pos++;
+                }
+            } else {
+                // the rest of the line without the $IFS chars at its end
+                pos = len;
+                while(pos > start && !escaped[pos - 1] && strchr(ifs, line[pos - 1])) {
+                    pos--;
+                }
+            }
+            char saved = line[pos];
+            line[pos] = 0;
+            setenv(argv[i], line + start, 1);
+            line[pos] = saved;
+        }
+    }
+    free(line);
+    free(escaped);
+    return !got_line;
+}
+
+
+/* private global var */
+Builtin builtins[] = {
+    {"exit", exit_builtin},
+    {"cd", cd_builtin},
+    {"pwd", pwd_builtin},
+    {"echo", echo_builtin},
+    {"printf", printf_builtin},
+    {"true", true_builtin},
+    {"false", false_builtin},
+    {"test", test_builtin},
+    {"[", test_builtin},
+    {"read", read_builtin},
+    {"hash", hash_builtin},
+    {"jobs", jobs_builtin},
+    {"fg", fg_builtin},
+    {"bg", bg_builtin},
+    {"wait", wait_builtin},
+    {NULL, NULL},
+};
+
+
+/* public function */
+BuiltinFunc find_builtin(const char *name) {
+    for(int i = 0; builtins[i].name; i++) {
+        if(strcmp(builtins[i].name, name) == 0) {
+            return builtins[i].func;
+        }
+    }
+    return NULL;
+}
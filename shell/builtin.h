@@ -0,0 +1,22 @@
+#ifndef _BUILTIN_H
+#define _BUILTIN_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+/*
+    commands run by the shell itself. the last stage of a pipeline runs
+    in the shell with its stdin and stdout dup'ed to the pipe and the
+    redirections, any other stage in a forked copy. a builtin writes to
+    stdout, which is flushed before anything else writes to the same fd.
+*/
+
+// argv is NULL terminated, the exit status is returned
+typedef int (*BuiltinFunc)(int argc, char **argv);
+
+// NULL if name is not a builtin
+BuiltinFunc find_builtin(const char *name);
+
+#endif
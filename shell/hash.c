@@ -0,0 +1,214 @@
+#include "hash.h"
+
+#define INIT_TABLE_SIZE 64
+// what execvp searches when PATH is unset
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+/* private global var */
+// open addressing, size is a power of two and at most half full
+CmdEntry *table = NULL;
+int table_size = 0, table_count = 0;
+// $PATH the table was filled from, any change empties it
+char *hashed_path = NULL;
+// a name found through a relative $PATH entry is not hashed, cd would break it
+char *unhashed = NULL;
+
+
+/* fnv-1a */
+uint32_t hash_name(const char *name) {
+    uint32_t hash = 2166136261u;
+    for(; *name; name++) {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+}
+
+/* slot of name, or the empty slot it would go in */
+CmdEntry *find_slot(const char *name) {
+    uint32_t mask = table_size - 1;
+    for(uint32_t i = hash_name(name) & mask; ; i = (i + 1) & mask) {
+        if(!table[i].name || strcmp(table[i].name, name) == 0) {
+            return &table[i];
+        }
+    }
+}
+
+void grow_table() {
+    CmdEntry *old = table;
+    int old_size = table_size;
+    table_size = table_size ? table_size * 2 : INIT_TABLE_SIZE;
+    table = calloc(table_size, sizeof(CmdEntry));
+    if(!table) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    for(int i = 0; i < old_size; i++) {
+        if(old[i].name) {
+            *find_slot(old[i].name) = old[i];
+        }
+    }
+    free(old);
+}
+
+/* search $PATH like execvp does, a malloc'ed path or NULL */
+char *search_path(const char *name, const char *path) {
+    size_t name_len = strlen(name);
+    char *buf = malloc(strlen(path) + name_len + 3);
+    if(!buf) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    while(true) {
+        const char *end = strchr(path, ':');
+        size_t len = end ? (size_t)(end - path) : strlen(path);
+        // an empty entry is the current directory
+        if(len) {
+            memcpy(buf, path, len);
+        } else {
+            buf[0] = '.';
+            len = 1;
+        }
+        buf[len] = '/';
+        memcpy(buf + len + 1, name, name_len + 1);
+        struct stat st;
+        if(stat(buf, &st) == 0 && S_ISREG(st.st_mode) && access(buf, X_OK) == 0) {
+            return buf;
+        }
+        if(!end) {
+            break;
+        }
+        path = end + 1;
+    }
+    free(buf);
+    return NULL;
+}
+
+/* the table only holds for the $PATH it was filled from */
+void check_path() {
+    const char *path = getenv("PATH");
+    if(!path) {
+        path = DEFAULT_PATH;
+    }
+    if(hashed_path && strcmp(hashed_path, path) == 0) {
+        return;
+    }
+    clear_cmd_hash();
+    hashed_path = strdup(path);
+    if(!hashed_path) {
+        perror("Memory leak!");
+        exit(1);
+    }
+}
+
+/* search $PATH for name, an absolute result is kept in the empty entry */
+const char *fill_entry(CmdEntry *entry, const char *name) {
+    char *path = search_path(name, hashed_path);
+    if(!path || path[0] != '/') {
+        free(unhashed);
+        unhashed = path;
+        return path;
+    }
+    if(!entry->name) {
+        if((table_count + 1) * 2 > table_size) {
+            grow_table();
+            entry = find_slot(name);
+        }
+        entry->name = strdup(name);
+        if(!entry->name) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        table_count++;
+    }
+    entry->path = path;
+    // this lookup is the first use
+    entry->hits = 1;
+    return path;
+}
+
+/* slot of name in a table filled from the current $PATH */
+CmdEntry *cmd_entry(const char *name) {
+    check_path();
+    if(!table_size) {
+        grow_table();
+    }
+    return find_slot(name);
+}
+
+
+/* public function */
+/* path to spawn for name, NULL if $PATH has no such command */
+const char *find_cmd(const char *name) {
+    // a path is used as is, like execvp
+    if(strchr(name, '/')) {
+        return name;
+    }
+    CmdEntry *entry = cmd_entry(name);
+    if(!entry->path) {
+        return fill_entry(entry, name);
+    }
+    entry->hits++;
+    return entry->path;
+}
+
+/* the hashed file is gone, search $PATH again */
+const char *rehash_cmd(const char *name) {
+    if(strchr(name, '/')) {
+        return NULL;
+    }
+    CmdEntry *entry = cmd_entry(name);
+    free(entry->path);
+    entry->path = NULL;
+    return fill_entry(entry, name);
+}
+
+void clear_cmd_hash() {
+    for(int i = 0; i < table_size; i++) {
+        free(table[i].name);
+        free(table[i].path);
+    }
+    free(table);
+    table = NULL;
+    table_size = table_count = 0;
+    free(hashed_path);
+    hashed_path = NULL;
+}
+
+/* hash: list what is remembered, hash -r: forget it all, hash name...: look them up now */
+int hash_builtin(int argc, char **argv) {
+    if(argc == 2 && strcmp(argv[1], "-r") == 0) {
+        clear_cmd_hash();
+        return 0;
+    }
+    if(argc > 1) {
+        int status = 0;
+        for(int i = 1; i < argc; i++) {
+            if(strchr(argv[i], '/')) {
+                continue;
+            }
+            const char *path = rehash_cmd(argv[i]);
+            if(!path) {
+                fprintf(stderr, "hash: %s: not found\n", argv[i]);
+                status = 1;
+            } else if(path[0] == '/') {
+                // looking it up is not a use
+                find_slot(argv[i])->hits = 0;
+            }
+        }
+        return status;
+    }
+    if(!table_count) {
+        printf("hash: hash table empty\n");
+        fflush(stdout);
+        return 0;
+    }
+    printf("hits\tcommand\n");
+    for(int i = 0; i < table_size; i++) {
+        if(table[i].path) {
+            printf("%4d\t%s\n", table[i].hits, table[i].path);
+        }
+    }
+    // before anything a command after it writes
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* command name -> absolute path, found once in $PATH and reused */
+typedef struct CmdEntry CmdEntry;
+struct CmdEntry {
+    char *name;
+    // NULL once the file is gone, the next lookup searches $PATH again
+    char *path;
+    int hits;
+};
+
+const char *find_cmd(const char *name);
+const char *rehash_cmd(const char *name);
+void clear_cmd_hash();
+// exit status, 1 if a name is not found
+int hash_builtin(int argc, char **argv);
+
+#endif
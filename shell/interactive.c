@@ -1,12 +1,19 @@
 #include "interactive.h"
+#include "jobs.h"
+
+#include <errno.h>
+#include <poll.h>
 
 extern bool IS_EXECUTING;
 /* public global var */
 bool IS_INTERACTIVE = false;
 
 /* private global var */
-struct passwd *user_info;
+// looked up once, ~ and the prompt need it all the time
+struct passwd *user_info = NULL;
 int home_len;
+// as of the last cd, so the prompt needs no getcwd
+char *cwd = NULL;
 
 
 /* ctrl-c handler */
@@ -30,16 +37,79 @@ void set_interactive_mode() {
     IS_INTERACTIVE = true;
 
     // init user info
-    user_info = getpwuid(getuid());
-    home_len = strlen(user_info->pw_dir);
+    home_dir();
 
     // parent process should ignore ctrl-c
     signal(SIGINT, sigint_ignore_handler);
+
+    init_job_control();
+}
+
+/*
+    YY_INPUT of the scanner. an interactive shell also waits for SIGCHLD
+    here, so background jobs are reaped while the prompt waits and not
+    only once the next line is entered.
+*/
+int read_input(FILE *in, char *buf, int max_size) {
+    int fd = fileno(in);
+    // the prompt, stdio flushed it only when it did the reading
+    fflush(stdout);
+    while(true) {
+        if(IS_INTERACTIVE) {
+            struct pollfd fds[2] = {
+                {.fd = fd, .events = POLLIN},
+                {.fd = job_event_fd(), .events = POLLIN},
+            };
+            if(poll(fds, 2, -1) < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                return 0;
+            }
+            if(fds[1].revents & POLLIN) {
+                reap_jobs();
+            }
+            if(!fds[0].revents) {
+                continue;
+            }
+        }
+        ssize_t n = read(fd, buf, max_size);
+        if(n >= 0) {
+            return n;
+        }
+        if(errno != EINTR) {
+            return 0;
+        }
+    }
+}
+
+const char *home_dir() {
+    if(!user_info) {
+        user_info = getpwuid(getuid());
+        home_len = strlen(user_info->pw_dir);
+    }
+    return user_info->pw_dir;
+}
+
+/* the cd builtin calls it after every chdir */
+void update_cwd() {
+    free(cwd);
+    cwd = getcwd(NULL, 0);
+    if(!cwd) {
+        // removed under us, show something rather than nothing
+        cwd = strdup(".");
+    }
+}
+
+const char *cur_dir() {
+    if(!cwd) {
+        update_cwd();
+    }
+    return cwd;
 }
 
 void print_bar() {
-    char cwd[1024];
-    getcwd(cwd, sizeof(cwd));
+    const char *cwd = cur_dir();
     if(strncmp(cwd, user_info->pw_dir, home_len) == 0) {
         printf("\033[1;36m%s\033[0m \033[1;32m~%s\033[0m$ ", user_info->pw_name, cwd + home_len);
     } else {
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdbool.h>
 
 #include <unistd.h>
@@ -10,9 +11,13 @@
 #include <sys/wait.h>
 #include <pwd.h>
 
-bool IS_INTERACTIVE;
+extern bool IS_INTERACTIVE;
 
 void set_interactive_mode();
+int read_input(FILE *in, char *buf, int max_size);
+const char *home_dir();
+void update_cwd();
+const char *cur_dir();
 void print_bar();
 void sigint_kill_handler();
 
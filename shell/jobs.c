@@ -0,0 +1,601 @@
+#define _GNU_SOURCE
+#include "jobs.h"
+#include "interactive.h"
+
+#include <termios.h>
+
+#define INIT_TABLE_SIZE 8
+// without a prompt nothing reports a done job, only wait may still ask for its status.
+// POSIX lets the shell forget statuses past CHILD_MAX, the oldest go first
+#define MAX_DONE_JOBS 256
+
+/* public global var */
+pid_t LAST_BG_PID = 0;
+
+/* private global var */
+// by id, ids only grow while the table isn't empty
+Job **job_table = NULL;
+int job_count = 0, job_cap = 0;
+unsigned long job_seq = 0;
+// SIGCHLD writes a byte, the prompt polls the other end
+int event_pipe[2] = {-1, -1};
+pid_t shell_pgid = 0;
+// terminal modes of the prompt, given back after every foreground job
+struct termios shell_tmodes;
+
+
+void sigchld_handler() {
+    int saved_errno = errno;
+    // non-blocking, a full pipe says enough already
+    write(event_pipe[1], "", 1);
+    errno = saved_errno;
+}
+
+/* status as $? shows it, 128 + signal for a killed command */
+int exit_status(int status) {
+    if(WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+/* the words of begin to end as they were typed */
+char *job_text(NodeList *begin, NodeList *end) {
+    char *text;
+    size_t size;
+    FILE *out = open_memstream(&text, &size);
+    if(!out) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    for(NodeList *list = begin; ; list = list->next) {
+        for(Node *node = list->begin; node; node = node->next) {
+            for(int i = 0; i < node->args->idx; i++) {
+                fprintf(out, i ? " %s" : "%s", node->args->val[i]);
+            }
+            if(node->in_path) {
+                fprintf(out, " < %s", node->in_path);
+            }
+            if(node->out_path) {
+                fprintf(out, node->out_append ? " >> %s" : " > %s", node->out_path);
+            }
+            if(node->next) {
+                fputs(" | ", out);
+            }
+        }
+        if(list == end) {
+            break;
+        }
+        fputs(list->sep == SEP_AND ? " && " : " || ", out);
+    }
+    fclose(out);
+    return text;
+}
+
+void free_job(Job *job) {
+    free(job->cmd);
+    free(job);
+}
+
+void add_job(Job *job) {
+    if(job_count == job_cap) {
+        job_cap = job_cap ? job_cap * 2 : INIT_TABLE_SIZE;
+        job_table = realloc(job_table, sizeof(Job*) * job_cap);
+        if(!job_table) {
+            perror("Memory leak!");
+            exit(1);
+        }
+    }
+    job->id = job_count ? job_table[job_count - 1]->id + 1 : 1;
+    job->seq = ++job_seq;
+    job_table[job_count++] = job;
+}
+
+void remove_job(Job *job) {
+    for(int i = 0; i < job_count; i++) {
+        if(job_table[i] == job) {
+            memmove(job_table + i, job_table + i + 1, sizeof(Job*) * (job_count - i - 1));
+            job_count--;
+            break;
+        }
+    }
+    job->id = 0;
+}
+
+/* take a job that's done out of the table, its status */
+int collect_job(Job *job) {
+    int status = job->procs[job->nproc - 1].status;
+    remove_job(job);
+    free_job(job);
+    return status;
+}
+
+Proc *find_proc(pid_t pid, Job **owner) {
+    for(int i = 0; i < job_count; i++) {
+        for(int j = 0; j < job_table[i]->nproc; j++) {
+            if(job_table[i]->procs[j].pid == pid) {
+                *owner = job_table[i];
+                return &job_table[i]->procs[j];
+            }
+        }
+    }
+    return NULL;
+}
+
+void set_proc_status(Proc *proc, int status) {
+    if(WIFSTOPPED(status)) {
+        proc->state = JOB_STOPPED;
+        proc->status = WSTOPSIG(status);
+    } else if(WIFCONTINUED(status)) {
+        proc->state = JOB_RUNNING;
+    } else {
+        proc->state = JOB_DONE;
+        proc->status = exit_status(status);
+    }
+}
+
+/* a job runs while any stage runs, and is stopped while any stage is */
+void update_job_state(Job *job) {
+    bool running = false, stopped = false;
+    for(int i = 0; i < job->nproc; i++) {
+        running |= job->procs[i].state == JOB_RUNNING;
+        stopped |= job->procs[i].state == JOB_STOPPED;
+    }
+    int state = running ? JOB_RUNNING : stopped ? JOB_STOPPED : JOB_DONE;
+    if(state != job->state) {
+        job->state = state;
+        job->notified = false;
+        if(state == JOB_STOPPED) {
+            job->seq = ++job_seq;
+        }
+    }
+}
+
+/* %+ with nth = 0, %- with nth = 1 */
+Job *current_job(int nth) {
+    Job *first = NULL, *second = NULL;
+    for(int i = 0; i < job_count; i++) {
+        Job *job = job_table[i];
+        if(!first || job->seq > first->seq) {
+            second = first;
+            first = job;
+        } else if(!second || job->seq > second->seq) {
+            second = job;
+        }
+    }
+    return nth ? second : first;
+}
+
+/* %%, %+, %-, %n, or n that is a job id or, with by_pid, a pid of the job */
+bool match_job(Job *job, const char *spec, bool by_pid) {
+    if(strcmp(spec, "%") == 0 || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+        return job == current_job(0);
+    }
+    if(strcmp(spec, "%-") == 0) {
+        return job == current_job(1);
+    }
+    if(spec[0] == '%' || !by_pid) {
+        return job->id == atoi(spec + (spec[0] == '%'));
+    }
+    for(int i = 0; i < job->nproc; i++) {
+        if(job->procs[i].pid == atoi(spec)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* the job of spec, the current one for NULL */
+Job *find_job(const char *spec, const char *name, bool by_pid) {
+    if(!spec) {
+        Job *job = current_job(0);
+        if(!job) {
+            fprintf(stderr, "%s: no current job\n", name);
+        }
+        return job;
+    }
+    for(int i = 0; i < job_count; i++) {
+        if(match_job(job_table[i], spec, by_pid)) {
+            return job_table[i];
+        }
+    }
+    fprintf(stderr, "%s: %s: no such job\n", name, spec);
+    return NULL;
+}
+
+void print_job(Job *job) {
+    char state[16] = "Running";
+    if(job->state == JOB_STOPPED) {
+        strcpy(state, "Stopped");
+    } else if(job->state == JOB_DONE) {
+        int status = job->procs[job->nproc - 1].status;
+        if(status) {
+            snprintf(state, sizeof(state), "Exit %d", status);
+        } else {
+            strcpy(state, "Done");
+        }
+    }
+    char mark = job == current_job(0) ? '+' : job == current_job(1) ? '-' : ' ';
+    printf("[%d]%c  %-10s%s\n", job->id, mark, state, job->cmd);
+    job->notified = true;
+}
+
+/* 128 + the stop signal of the first stopped stage, -1 if none is */
+int stopped_status(Job *job) {
+    for(int i = 0; i < job->nproc; i++) {
+        if(job->procs[i].state == JOB_STOPPED) {
+            return 128 + job->procs[i].status;
+        }
+    }
+    return -1;
+}
+
+/* a script keeps only the last MAX_DONE_JOBS done jobs, and always the one of $! */
+void forget_done_jobs() {
+    int done = 0;
+    for(int i = 0; i < job_count; i++) {
+        done += job_table[i]->state == JOB_DONE;
+    }
+    for(int i = 0; i < job_count && done > MAX_DONE_JOBS; i++) {
+        Job *job = job_table[i];
+        Job *owner = NULL;
+        if(job->state != JOB_DONE || (find_proc(LAST_BG_PID, &owner) && owner == job)) {
+            continue;
+        }
+        collect_job(job);
+        done--;
+        i--;
+    }
+}
+
+/* block until every stage of the job is done, a stopped job isn't waited for */
+int wait_done(Job *job) {
+    for(int i = 0; i < job->nproc; i++) {
+        Proc *proc = &job->procs[i];
+        // like bash, 128 + SIGTSTP for ctrl-z, the job stays for fg and bg
+        int stopped = stopped_status(job);
+        if(stopped >= 0) {
+            update_job_state(job);
+            return stopped;
+        }
+        while(proc->state == JOB_RUNNING) {
+            int status;
+            if(waitpid(proc->pid, &status, WUNTRACED) < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                // reaped elsewhere, nothing to wait for
+                proc->state = JOB_DONE;
+                break;
+            }
+            set_proc_status(proc, status);
+        }
+    }
+    update_job_state(job);
+    return collect_job(job);
+}
+
+/* wait -n: the next job of the list, or any, to be done */
+int wait_next(int argc, char **argv) {
+    while(true) {
+        // one done already counts as the next
+        bool running = false;
+        for(int i = 0; i < job_count; i++) {
+            Job *job = job_table[i];
+            bool listed = !argc;
+            for(int j = 0; j < argc && !listed; j++) {
+                listed = match_job(job, argv[j], true);
+            }
+            if(!listed) {
+                continue;
+            }
+            if(job->state == JOB_DONE) {
+                return collect_job(job);
+            }
+            if(job->state == JOB_STOPPED) {
+                return stopped_status(job);
+            }
+            running = true;
+        }
+        if(!running) {
+            return 127;
+        }
+        int status;
+        pid_t pid = waitpid(-1, &status, WUNTRACED);
+        if(pid < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return 127;
+        }
+        Job *job;
+        Proc *proc = find_proc(pid, &job);
+        if(proc) {
+            set_proc_status(proc, status);
+            update_job_state(job);
+        }
+    }
+}
+
+void continue_job(Job *job) {
+    for(int i = 0; i < job->nproc; i++) {
+        if(job->procs[i].state == JOB_STOPPED) {
+            job->procs[i].state = JOB_RUNNING;
+        }
+    }
+    update_job_state(job);
+    kill(-job->pgid, SIGCONT);
+}
+
+
+/* public function */
+/* own process group and the terminal, SIGCHLD lands in the self-pipe */
+void init_job_control() {
+    // started in the background, wait to be put in front
+    while(tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp())) {
+        kill(-shell_pgid, SIGTTIN);
+    }
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+
+    // ctrl-c and ctrl-z of a job go to its group and not to the shell
+    setpgid(0, 0);
+    shell_pgid = getpgrp();
+    tcsetpgrp(STDIN_FILENO, shell_pgid);
+    tcgetattr(STDIN_FILENO, &shell_tmodes);
+
+    if(pipe2(event_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        perror("error shell");
+        exit(1);
+    }
+    struct sigaction act = {0};
+    act.sa_handler = sigchld_handler;
+    act.sa_flags = SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGCHLD, &act, NULL);
+}
+
+int job_event_fd() {
+    return event_pipe[0];
+}
+
+void forget_jobs() {
+    // the entries are the parent's, the copies just stay
+    job_count = 0;
+    signal(SIGCHLD, SIG_DFL);
+    if(event_pipe[0] >= 0) {
+        close(event_pipe[0]);
+        close(event_pipe[1]);
+        event_pipe[0] = event_pipe[1] = -1;
+    }
+}
+
+Job *new_job(NodeList *begin, NodeList *end, int nproc) {
+    Job *job = calloc(1, sizeof(Job) + sizeof(Proc) * nproc);
+    if(!job) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    job->nproc = nproc;
+    job->state = JOB_RUNNING;
+    job->cmd = job_text(begin, end);
+    return job;
+}
+
+/* stage idx started as pid, or is done with status when pid <= 0 */
+void set_job_proc(Job *job, int idx, pid_t pid, int status) {
+    Proc *proc = &job->procs[idx];
+    if(pid <= 0) {
+        proc->state = JOB_DONE;
+        proc->status = status;
+        return;
+    }
+    proc->pid = pid;
+    proc->state = JOB_RUNNING;
+    if(!job->pgid) {
+        job->pgid = pid;
+    }
+    if(IS_INTERACTIVE) {
+        // the child did it too, whoever is first wins the race with exec
+        setpgid(pid, job->pgid);
+    }
+}
+
+int wait_job(Job *job) {
+    if(IS_INTERACTIVE && job->pgid) {
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+    }
+    // any child, a background job done meanwhile doesn't stay a zombie
+    update_job_state(job);
+    while(job->state == JOB_RUNNING) {
+        int status;
+        pid_t pid = waitpid(-1, &status, WUNTRACED);
+        if(pid < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            // no children left, nothing to wait for
+            for(int i = 0; i < job->nproc; i++) {
+                job->procs[i].state = JOB_DONE;
+            }
+            break;
+        }
+        Job *owner = job;
+        Proc *proc = NULL;
+        for(int i = 0; i < job->nproc && !proc; i++) {
+            if(job->procs[i].pid == pid) {
+                proc = &job->procs[i];
+            }
+        }
+        if(!proc) {
+            proc = find_proc(pid, &owner);
+        }
+        if(proc) {
+            set_proc_status(proc, status);
+            update_job_state(owner);
+        }
+    }
+    if(IS_INTERACTIVE) {
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+    }
+    update_job_state(job);
+    if(job->state == JOB_STOPPED) {
+        if(!job->id) {
+            add_job(job);
+        }
+        job->seq = ++job_seq;
+        printf("\n");
+        print_job(job);
+        return stopped_status(job);
+    }
+    if(job->id) {
+        return collect_job(job);
+    }
+    int status = job->procs[job->nproc - 1].status;
+    free_job(job);
+    return status;
+}
+
+void put_job_background(Job *job) {
+    add_job(job);
+    for(int i = job->nproc - 1; i >= 0; i--) {
+        if(job->procs[i].pid) {
+            LAST_BG_PID = job->procs[i].pid;
+            break;
+        }
+    }
+    update_job_state(job);
+    if(IS_INTERACTIVE) {
+        printf("[%d] %d\n", job->id, LAST_BG_PID);
+        fflush(stdout);
+    }
+}
+
+/* every child that changed state, never blocks */
+void reap_jobs() {
+    char buf[64];
+    if(event_pipe[0] >= 0) {
+        // a SIGCHLD after this is seen the next time
+        while(read(event_pipe[0], buf, sizeof(buf)) > 0) {
+        }
+    }
+    pid_t pid;
+    int status;
+    while((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
+        Job *job;
+        Proc *proc = find_proc(pid, &job);
+        if(proc) {
+            set_proc_status(proc, status);
+            update_job_state(job);
+        }
+    }
+    if(!IS_INTERACTIVE) {
+        forget_done_jobs();
+    }
+}
+
+void notify_jobs() {
+    reap_jobs();
+    for(int i = 0; i < job_count; i++) {
+        Job *job = job_table[i];
+        if(!job->notified && job->state != JOB_RUNNING) {
+            print_job(job);
+        }
+        if(job->state == JOB_DONE) {
+            collect_job(job);
+            i--;
+        }
+    }
+    fflush(stdout);
+}
+
+/* jobs: the table, jobs -p: process group of each job */
+int jobs_builtin(int argc, char **argv) {
+    reap_jobs();
+    bool pgid_only = argc > 1 && strcmp(argv[1], "-p") == 0;
+    for(int i = 0; i < job_count; i++) {
+        Job *job = job_table[i];
+        if(pgid_only) {
+            printf("%d\n", job->pgid);
+        } else {
+            print_job(job);
+        }
+        // a done job is reported once
+        if(job->state == JOB_DONE && !pgid_only) {
+            collect_job(job);
+            i--;
+        }
+    }
+    fflush(stdout);
+    return 0;
+}
+
+int fg_builtin(int argc, char **argv) {
+    if(!IS_INTERACTIVE) {
+        fprintf(stderr, "fg: no job control\n");
+        return 1;
+    }
+    Job *job = find_job(argc > 1 ? argv[1] : NULL, "fg", false);
+    if(!job) {
+        return 1;
+    }
+    printf("%s\n", job->cmd);
+    fflush(stdout);
+    continue_job(job);
+    return wait_job(job);
+}
+
+int bg_builtin(int argc, char **argv) {
+    if(!IS_INTERACTIVE) {
+        fprintf(stderr, "bg: no job control\n");
+        return 1;
+    }
+    Job *job = find_job(argc > 1 ? argv[1] : NULL, "bg", false);
+    if(!job) {
+        return 1;
+    }
+    if(job->state != JOB_STOPPED) {
+        fprintf(stderr, "bg: job %d already in background\n", job->id);
+        return 0;
+    }
+    continue_job(job);
+    printf("[%d]+ %s &\n", job->id, job->cmd);
+    fflush(stdout);
+    return 0;
+}
+
+/* wait: every job, wait id...: those, status of the last, wait -n [id...]: the next one done */
+int wait_builtin(int argc, char **argv) {
+    reap_jobs();
+    if(argc > 1 && strcmp(argv[1], "-n") == 0) {
+        return wait_next(argc - 2, argv + 2);
+    }
+    if(argc == 1) {
+        for(int i = 0; i < job_count;) {
+            // a done job leaves the table, a stopped one stays
+            int count = job_count;
+            wait_done(job_table[i]);
+            i += job_count == count;
+        }
+        return 0;
+    }
+    int status = 0;
+    for(int i = 1; i < argc; i++) {
+        Job *job = NULL;
+        for(int j = 0; j < job_count && !job; j++) {
+            if(match_job(job_table[j], argv[i], true)) {
+                job = job_table[j];
+            }
+        }
+        if(!job) {
+            fprintf(stderr, "wait: %s: no such job\n", argv[i]);
+            status = 127;
+            continue;
+        }
+        status = wait_done(job);
+    }
+    return status;
+}
@@ -0,0 +1,76 @@
+#ifndef _JOBS_H
+#define _JOBS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "node.h"
+
+/*
+    a job is one pipeline, or an and-or list run in the background by a
+    copy of the shell. a foreground job only goes into the table when it's
+    stopped, a background one right away. with job control (an interactive
+    shell) every job has its own process group and the foreground one
+    owns the terminal.
+*/
+
+enum { JOB_RUNNING, JOB_STOPPED, JOB_DONE };
+
+typedef struct Proc Proc;
+struct Proc {
+    // 0 for a builtin stage or one that couldn't start, it's done already
+    pid_t pid;
+    int state;
+    // exit status as $? shows it once done, stop signal while stopped
+    int status;
+};
+
+typedef struct Job Job;
+struct Job {
+    // %id, 0 while not in the table
+    int id;
+    pid_t pgid;
+    int state;
+    // the command line as typed, for jobs, fg and bg
+    char *cmd;
+    // the larger, the more recently started or stopped, the largest is %+
+    unsigned long seq;
+    // the state was reported since it last changed
+    bool notified;
+    int nproc;
+    Proc procs[];
+};
+
+// the pid of the last background job, $!
+extern pid_t LAST_BG_PID;
+
+void init_job_control();
+// the read end of the SIGCHLD self-pipe, readable once a child changed state
+int job_event_fd();
+// a child of the shell copy running a background list, the table isn't its own
+void forget_jobs();
+
+Job *new_job(NodeList *begin, NodeList *end, int nproc);
+void set_job_proc(Job *job, int idx, pid_t pid, int status);
+// status of the last stage, 128 + signal if it got stopped and went into the table
+int wait_job(Job *job);
+void put_job_background(Job *job);
+
+int exit_status(int status);
+void reap_jobs();
+// report jobs that finished or stopped since the last prompt
+void notify_jobs();
+
+int jobs_builtin(int argc, char **argv);
+int fg_builtin(int argc, char **argv);
+int bg_builtin(int argc, char **argv);
+int wait_builtin(int argc, char **argv);
+
+#endif
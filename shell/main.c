@@ -2,6 +2,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "node.h"
 #include "parser.h"
@@ -9,11 +12,94 @@
 #include "interactive.h"
 
 extern int yyparse();
+extern int LAST_STATUS;
 
-/* main shell function */
-int main() {
-    /* TODO: support script mode */
-    set_interactive_mode();
-    print_bar();
+/*
+    a script is scanned straight from one buffer: flex wants two NULs after
+    the text and a line without \n at the end would never run, so there is
+    room for three more bytes.
+*/
+char *new_script_buf(size_t len) {
+    char *buf = malloc(len + 3);
+    if(!buf) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    return buf;
+}
+
+/* the scanner runs over buf in place, nothing is read while the script runs */
+void run_script(char *buf, size_t len) {
+    if(len == 0 || buf[len - 1] != '\n') {
+        buf[len++] = '\n';
+    }
+    buf[len] = buf[len + 1] = '\0';
+    YY_BUFFER_STATE state = yy_scan_buffer(buf, len + 2);
     yyparse();
+    yy_delete_buffer(state);
+    free(buf);
+}
+
+/* ash file: the whole file is read at once, stdin is left to the commands */
+void run_script_file(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "ash: %s: %s\n", path, strerror(errno));
+        exit(127);
+    }
+    // st_size is only a hint, a pipe or /dev/stdin has none
+    size_t cap = S_ISREG(st.st_mode) && st.st_size > 0 ? st.st_size : 1 << 16;
+    size_t len = 0;
+    char *buf = new_script_buf(cap);
+    while(true) {
+        if(len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap + 3);
+            if(!buf) {
+                perror("Memory leak!");
+                exit(1);
+            }
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if(n < 0) {
+            fprintf(stderr, "ash: %s: %s\n", path, strerror(errno));
+            exit(1);
+        }
+        if(n == 0) {
+            break;
+        }
+        len += n;
+    }
+    close(fd);
+    run_script(buf, len);
+}
+
+/* ash -c 'cmds' */
+void run_script_str(const char *str) {
+    size_t len = strlen(str);
+    char *buf = new_script_buf(len);
+    memcpy(buf, str, len);
+    run_script(buf, len);
+}
+
+/* main shell function */
+int main(int argc, char *argv[]) {
+    if(argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if(argc == 2) {
+            fprintf(stderr, "ash: -c: option requires an argument\n");
+            exit(2);
+        }
+        run_script_str(argv[2]);
+    } else if(argc > 1) {
+        run_script_file(argv[1]);
+    } else if(isatty(STDIN_FILENO)) {
+        set_interactive_mode();
+        print_bar();
+        yyparse();
+    } else {
+        // commands piped in, flex reads them in blocks and there is no prompt
+        yyparse();
+    }
+    return LAST_STATUS;
 }
@@ -2,7 +2,7 @@
 
 /* node function */
 Node *new_node(ArgList *args, char *in_path, char *out_path, bool in_append, bool out_append) {
-    Node *cur_node = calloc(1, sizeof(Node));
+    Node *cur_node = arena_alloc(sizeof(Node));
 
     cur_node->args = args;
     cur_node->in_append = in_append;
@@ -12,19 +12,9 @@ Node *new_node(ArgList *args, char *in_path, char *out_path, bool in_append, boo
     return cur_node;
 }
 
-Node *free_node(Node *cur_node) {
-    // TODO: free args
-    free(cur_node->in_path);
-    free(cur_node->out_path);
-
-    Node *next = cur_node->next;
-    free(cur_node);
-    return next;
-}
-
 /* node list function */
 NodeList *new_node_list() {
-    return calloc(1, sizeof(NodeList));
+    return arena_alloc(sizeof(NodeList));
 }
 
 void push_node(NodeList *list, Node *new_node) {
@@ -35,28 +25,38 @@ void push_node(NodeList *list, Node *new_node) {
         list->end->next = new_node;
         list->end = new_node;
     }
+    list->len++;
 }
 
-void free_node_list(NodeList *list) {
-    Node *cur_node = list->begin;
-    while(cur_node) {
-        cur_node = free_node(cur_node);
+/* cmd list function */
+CmdList *new_cmd_list() {
+    return arena_alloc(sizeof(CmdList));
+}
+
+void push_pipeline(CmdList *list, NodeList *pipeline) {
+    if(!(list->begin)) {
+        list->begin = pipeline;
+    } else {
+        list->end->next = pipeline;
     }
-    free(list);
+    list->end = pipeline;
 }
 
 /* arg list function */
 ArgList *new_arg_list() {
-    ArgList *cur_list = calloc(1, sizeof(ArgList));
+    ArgList *cur_list = arena_alloc(sizeof(ArgList));
     cur_list->idx = 0;
-    cur_list->capacity = 2;
-    // cur_list->val = calloc(1, sizeof(char*) * cur_list->capacity);
+    cur_list->capacity = 8;
+    cur_list->val = arena_alloc(sizeof(char*) * cur_list->capacity);
     return cur_list;
 }
 
 void push_arg(ArgList *list, char *arg) {
-    // TODO: realloc
-    if(list->idx >= list->capacity) {
+    // one slot is kept for the NULL
+    if(list->idx + 1 >= list->capacity) {
+        list->val = arena_grow(list->val, sizeof(char*) * list->capacity,
+                               sizeof(char*) * list->capacity * 2);
+        list->capacity *= 2;
     }
     list->val[(list->idx)++] = arg;
 }
@@ -102,8 +102,7 @@ char **parse_arg() {
 /* debug function */
 void print_cmd(Node *cur_node) {
     printf("command: ");
-    for(int i=0 ;i<10; i++) {
-        if(!cur_node->args->val[i]) break;
+    for(int i=0 ;i<cur_node->args->idx; i++) {
         printf(" %s", cur_node->args->val[i]);
     }
     printf("\n");
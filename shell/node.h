@@ -6,11 +6,19 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include "arena.h"
+
+/*
+    everything here lives in the arena of the command line being parsed,
+    reset_arena frees it all after run_cmd
+*/
+
 /* arg list */
 typedef struct ArgList ArgList;
 struct ArgList {
     int idx, capacity;
-    char *val[10];
+    // always NULL terminated, ready for exec
+    char **val;
 };
 
 ArgList *new_arg_list();
@@ -28,16 +36,34 @@ struct Node {
 
 Node *new_node(ArgList *args, char *in_path, char *out_path, bool in_append, bool out_append);
 
-/* node linked list */
+/* node linked list, one pipeline */
+// what joins a pipeline to the next one of the line
+enum { SEP_SEQ, SEP_AND, SEP_OR, SEP_BG };
+
 typedef struct NodeList NodeList;
 struct NodeList {
     Node *begin, *end;
+    int len;
+    int sep;
+    NodeList *next;
 };
 
 NodeList *new_node_list();
-void free_node_list(NodeList *list);
 void push_node(NodeList *list, Node *new_node);
 
+/*
+    pipelines of one line in order. && and || bind tighter than ; and &,
+    all of them left to right, so the list needs no tree: an and-or list
+    runs up to the first ; or &.
+*/
+typedef struct CmdList CmdList;
+struct CmdList {
+    NodeList *begin, *end;
+};
+
+CmdList *new_cmd_list();
+void push_pipeline(CmdList *list, NodeList *pipeline);
+
 /* function declaration */
 void print_tree(NodeList *cur_node);
 
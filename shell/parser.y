@@ -1,31 +1,39 @@
 %{
+    #define _GNU_SOURCE
     #include <stdio.h>
     #include <stdbool.h>
     #include <stdlib.h>
+    #include <string.h>
+    #include <errno.h>
+    #include <ctype.h>
     #include <unistd.h>
     #include <fcntl.h>
+    #include <spawn.h>
+    #include <sys/stat.h>
 
     #include "node.h"
     #include "interactive.h"
-
-    #define PIPE_SIZE 50
+    #include "hash.h"
+    #include "jobs.h"
+    #include "builtin.h"
 
     extern bool IS_INTERACTIVE;
     extern int yylex();
     extern FILE *yyin;
     extern int yylineno;
+    extern char **environ;
 
     bool IS_EXECUTING = false;
+    // exit status of the last pipeline, $?
+    int LAST_STATUS = 0;
     /* pipe idx */
     #define READ 0
     #define WRITE 1
     bool HAS_CHILD = false;
 
-    void run_cmd(NodeList *list);
-    void free_node_list(NodeList *list);
-    char *expand_quote(char *str);
+    void run_line(CmdList *line);
     void yyerror(const char* msg) {
-        printf("ash: %s", msg);
+        fprintf(stderr, "ash: %s\n", msg);
     }
 %}
 
@@ -33,6 +41,8 @@
     char *str;
     char **args;
     NodeList *nodeList;
+    CmdList *cmdList;
+    int sep;
     Node *node;
     ArgList *argList;
 }
@@ -43,12 +53,17 @@
 // pipe
 %token PIPE
 
+// list of commands
+%token AND_IF OR_IF SEMI AMP
+
 // basic type
 %token <str>QUOTE
 
 %token EOL
 
 /* non terminal */
+%type <cmdList> line cmd_list
+%type <sep> list_sep
 %type <nodeList> stmt_list
 %type <node> redirection
 %type <str> path
@@ -58,22 +73,49 @@
 program:
        | error EOL {
            yyerrok;
+           reset_arena();
+           LAST_STATUS = 2;
            if(IS_INTERACTIVE) {
-               printf("\n");
+               notify_jobs();
                print_bar();
            }
        }
        | program EOL {
            if(IS_INTERACTIVE) {
+               notify_jobs();
                print_bar();
            }
        }
-       | program stmt_list EOL {
-           run_cmd($2);
-           free_node_list($2);
+       | program line EOL {
+           run_line($2);
+           reset_arena();
+           if(IS_INTERACTIVE) {
+               notify_jobs();
+               print_bar();
+           }
        }
        ;
 
+line: cmd_list
+    | cmd_list SEMI { $$->end->sep = SEP_SEQ; }
+    | cmd_list AMP { $$->end->sep = SEP_BG; }
+    ;
+
+cmd_list: stmt_list { $$ = new_cmd_list(); push_pipeline($$, $1); }
+        | cmd_list list_sep stmt_list { $$->end->sep = $2; push_pipeline($$, $3); }
+        ;
+
+list_sep: SEMI { $$ = SEP_SEQ; }
+        | AMP { $$ = SEP_BG; }
+        | AND_IF newlines { $$ = SEP_AND; }
+        | OR_IF newlines { $$ = SEP_OR; }
+        ;
+
+// a chain may go on in the next line after && and ||
+newlines:
+        | newlines EOL
+        ;
+
 stmt_list: redirection { $$ = new_node_list(); push_node($$, $1); }
          | stmt_list PIPE redirection { push_node($$, $3); }
          ;
@@ -91,11 +133,12 @@ redirection: cmd { $$ = new_node($1, NULL, NULL, false, false); }
            | cmd RED_A_OUT path RED_IN path { $$ = new_node($1, $5, $3, false, true); }
            ;
 
-path: QUOTE { $$ = expand_quote($1); }
+// words are expanded when they run, $? isn't known before
+path: QUOTE
     ;
 
-cmd: QUOTE { $$ = new_arg_list(); push_arg($$, expand_quote($1)); }
-   | cmd QUOTE{ push_arg($$, expand_quote($2)); }
+cmd: QUOTE { $$ = new_arg_list(); push_arg($$, $1); }
+   | cmd QUOTE{ push_arg($$, $2); }
    ;
 
 
@@ -161,124 +204,449 @@ bool is_ansi_esc() {
 }
 
 /* execute function */
+/*
+    the value of the parameter named right after a $, NULL if there is
+    none there. *len is how long the name is, $? and $! are written to buf.
+*/
+const char *param_value(const char *str, size_t *len, char *buf) {
+    if(str[0] == '?' || str[0] == '!') {
+        sprintf(buf, "%d", str[0] == '?' ? LAST_STATUS : LAST_BG_PID);
+        *len = 1;
+        return buf;
+    }
+    bool brace = str[0] == '{';
+    const char *name = str + brace;
+    size_t name_len = 0;
+    while(isalnum((unsigned char)name[name_len]) || name[name_len] == '_') {
+        name_len++;
+    }
+    if(!name_len || isdigit((unsigned char)name[0]) || (brace && name[name_len] != '}')) {
+        return NULL;
+    }
+    *len = name_len + 2 * brace;
+    char *key = arena_alloc(name_len + 1);
+    memcpy(key, name, name_len);
+    const char *value = getenv(key);
+    return value ? value : "";
+}
+
+/*
+    expand str from begin to end into out, or only count with out NULL,
+    the length. a \ takes the next char as it is, in double quotes only
+    before $ " and \, and ~ is the home directory outside of them.
+*/
+size_t expand_word(const char *str, size_t begin, size_t end, bool quoted, char *out) {
+    size_t j = 0;
+    char buf[16];
+    for(size_t i=begin; i<end; i++) {
+        const char *value = NULL;
+        size_t name_len;
+        if(str[i] == '\\' && (!quoted || (i + 1 < end && strchr("$\"\\", str[i+1])))) {
+            if(++i == end) {
+                break;
+            }
+        } else if(str[i] == '$') {
+            value = param_value(str + i + 1, &name_len, buf);
+        } else if(str[i] == '~' && !quoted) {
+            value = home_dir();
+            name_len = 0;
+        }
+        if(!value) {
+            if(out) {
+                out[j] = str[i];
+            }
+            j++;
+            continue;
+        }
+        size_t value_len = strlen(value);
+        if(out) {
+            memcpy(out + j, value, value_len);
+        }
+        j += value_len;
+        i += name_len;
+    }
+    return j;
+}
+
 char* expand_quote(char *str) {
     /* TODO: support special char */
-    char *new_str = calloc(1, sizeof(char) * strlen(str) - 1);
-    if(str[0] == '\'' || str[0] == '\"') {
-        strncpy(new_str, str+1, strlen(str) - 2);
-    } else {
-        // get home info
-        const char *home = getpwuid(getuid())->pw_dir;
-
-        /* TODO: check if \\ need to be removed */
-        for(int i=0, j=0; i<strlen(str); i++) {
-            if(str[i] == '~') {
-                int new_len = strlen(str) - 1 + strlen(home);
-                new_str = realloc(new_str, sizeof(char) * new_len);
-                strcpy(new_str+j, home);
-                j += strlen(home);
-            }else if(str[i] != '\\') {
-                new_str[j++] = str[i];
+    size_t len = strlen(str);
+    if(len >= 2 && str[0] == '\'' && str[len - 1] == str[0]) {
+        char *new_str = arena_alloc(len - 1);
+        memcpy(new_str, str+1, len - 2);
+        return new_str;
+    }
+    bool quoted = len >= 2 && str[0] == '\"' && str[len - 1] == str[0];
+    // one pass for the length, one to write
+    size_t new_len = expand_word(str, quoted, len - quoted, quoted, NULL);
+    char *new_str = arena_alloc(new_len + 1);
+    expand_word(str, quoted, len - quoted, quoted, new_str);
+    return new_str;
+}
+
+/* expand every word of a pipeline stage right before it runs */
+void expand_node(Node *cur_node) {
+    for(int i=0; i<cur_node->args->idx; i++) {
+        cur_node->args->val[i] = expand_quote(cur_node->args->val[i]);
+    }
+    if(cur_node->in_path) {
+        cur_node->in_path = expand_quote(cur_node->in_path);
+    }
+    if(cur_node->out_path) {
+        cur_node->out_path = expand_quote(cur_node->out_path);
+    }
+}
+
+/* flags of the file a redirection writes to */
+int out_flags(Node *cur_node) {
+    return O_WRONLY | O_CREAT | (cur_node->out_append ? O_APPEND : O_TRUNC);
+}
+
+/*
+    open the redirections of a stage in the shell, -1 for one it doesn't
+    have. false once a file can't be opened, the stage then doesn't run.
+*/
+bool open_redirs(Node *cur_node, int *redir_in, int *redir_out) {
+    *redir_in = *redir_out = -1;
+    if(cur_node->in_path) {
+        *redir_in = open(cur_node->in_path, O_RDONLY | O_CLOEXEC);
+        if(*redir_in < 0) {
+            fprintf(stderr, "error shell: %s: %s\n", cur_node->in_path, strerror(errno));
+            return false;
+        }
+    }
+    if(cur_node->out_path) {
+        *redir_out = open(cur_node->out_path, out_flags(cur_node) | O_CLOEXEC, 0644);
+        if(*redir_out < 0) {
+            fprintf(stderr, "error shell: %s: %s\n", cur_node->out_path, strerror(errno));
+            if(*redir_in >= 0) {
+                close(*redir_in);
+                *redir_in = -1;
             }
+            return false;
         }
     }
-    return new_str;
+    return true;
+}
+
+/*
+    start one pipeline stage without copying the shell: posix_spawn runs
+    the child on the parent's memory until it execs. in_fd and out_fd are
+    the pipe ends or the redirections for stdin and stdout, -1 keeps the
+    shell's own. the shell opens them all close-on-exec, dup2 clears the
+    flag on the copy only. path is the
+    hashed file of the command, so there's no $PATH walk per stage.
+
+    with job control the stage joins the process group pgid, 0 starts a
+    new one, and a foreground stage takes the terminal before it execs,
+    so it can't read from it while still in the background.
+*/
+pid_t spawn_cmd(Node *cur_node, const char *path, int in_fd, int out_fd,
+                pid_t pgid, bool foreground, int *err) {
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if(IS_INTERACTIVE && foreground && !pgid) {
+        // on the shell's stdin, before it becomes a pipe
+        posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+    }
+    // the redirections are opened already, in_fd and out_fd are them or the pipe
+    if(in_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    }
+    if(out_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    }
+    // the shell catches SIGINT, exec puts it back to default so ctrl-c kills the command
+    if(IS_INTERACTIVE) {
+        // the signals ignored for job control are not, exec keeps them ignored
+        sigset_t sig_default;
+        sigemptyset(&sig_default);
+        sigaddset(&sig_default, SIGQUIT);
+        sigaddset(&sig_default, SIGTSTP);
+        sigaddset(&sig_default, SIGTTIN);
+        sigaddset(&sig_default, SIGTTOU);
+        posix_spawnattr_setsigdefault(&attr, &sig_default);
+        posix_spawnattr_setpgroup(&attr, pgid);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF);
+    }
+    pid_t pid;
+    *err = posix_spawn(&pid, path, &actions, &attr, cur_node->args->val, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return *err ? -1 : pid;
+}
+
+/* in a forked stage: its process group, signals and stdin and stdout */
+void setup_child(int in_fd, int out_fd, pid_t pgid, bool foreground) {
+    // set ctrl-c handler
+    signal(SIGINT, sigint_kill_handler);
+    if(IS_INTERACTIVE) {
+        setpgid(0, pgid);
+        if(foreground && !pgid) {
+            tcsetpgrp(STDIN_FILENO, getpgrp());
+        }
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+    }
+    if(in_fd >= 0) {
+        dup2(in_fd, STDIN_FILENO);
+    }
+    if(out_fd >= 0) {
+        dup2(out_fd, STDOUT_FILENO);
+    }
+}
+
+/* fork and execvp, only for what posix_spawn can't run: a script without #! */
+pid_t fork_cmd(Node *cur_node, int in_fd, int out_fd, pid_t pgid, bool foreground) {
+    pid_t pid = fork();
+    if(pid < 0) {
+        // error forking
+        perror("error shell");
+    }
+    if(pid != 0) {
+        return pid;
+    }
+    // child process
+    setup_child(in_fd, out_fd, pgid, foreground);
+
+    // execvp hands a file without #! to /bin/sh
+    execvp(cur_node->args->val[0], cur_node->args->val);
+    perror("error shell");
+    exit(127);
+}
+
+/* a builtin that isn't the last stage, or runs in the background, gets a copy of the shell */
+pid_t fork_builtin(BuiltinFunc builtin, Node *cur_node, int in_fd, int out_fd, pid_t pgid, bool foreground) {
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("error shell");
+    }
+    if(pid != 0) {
+        return pid;
+    }
+    setup_child(in_fd, out_fd, pgid, foreground);
+    IS_INTERACTIVE = false;
+    int status = builtin(cur_node->args->idx, cur_node->args->val);
+    fflush(stdout);
+    _exit(status);
+}
+
+/* stdout and stderr go to the same file, like with 2>&1, the shell never changes them */
+bool stdout_is_stderr() {
+    static int same = -1;
+    if(same < 0) {
+        struct stat out_st, err_st;
+        same = fstat(STDOUT_FILENO, &out_st) == 0 && fstat(STDERR_FILENO, &err_st) == 0 &&
+            out_st.st_dev == err_st.st_dev && out_st.st_ino == err_st.st_ino;
+    }
+    return same;
+}
+
+/*
+    the last stage as a builtin in the shell itself: stdin and stdout are
+    dup'ed to the pipe and the redirections while it runs, then put back.
+    with neither, output stays in the stdout buffer, a line of echo costs
+    no syscall at all, unless stderr is the same file and the order of
+    what the two print matters.
+*/
+int run_builtin_here(BuiltinFunc builtin, Node *cur_node, int in_fd, int out_fd) {
+    int saved_in = -1, saved_out = -1;
+    if(in_fd >= 0) {
+        saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(in_fd, STDIN_FILENO);
+    }
+    if(out_fd >= 0) {
+        // what the shell wrote so far goes to the old stdout
+        fflush(stdout);
+        saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(out_fd, STDOUT_FILENO);
+    }
+
+    int status = builtin(cur_node->args->idx, cur_node->args->val);
+
+    if(saved_in >= 0) {
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+    }
+    if(saved_out >= 0) {
+        fflush(stdout);
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+    } else if(stdout_is_stderr()) {
+        fflush(stdout);
+    }
+    return status;
 }
 
-void cd(char *direction) {
-    if(chdir(direction) != 0) {
-        printf("cd: no such file or directory: %s\n", direction);
+/* start a stage that isn't a builtin run in the shell, its pid, -1 with status set if it didn't start */
+pid_t start_stage(BuiltinFunc builtin, Node *cur_node, int in_fd, int out_fd,
+                  pid_t pgid, bool foreground, int *status) {
+    // what the shell printed so far goes before what the commands print
+    fflush(stdout);
+    pid_t pid = -1;
+    int err = ENOENT;
+    const char *path = builtin ? NULL : find_cmd(cur_node->args->val[0]);
+    if(builtin) {
+        pid = fork_builtin(builtin, cur_node, in_fd, out_fd, pgid, foreground);
+        err = pid < 0 ? errno : 0;
+    } else if(path) {
+        pid = spawn_cmd(cur_node, path, in_fd, out_fd, pgid, foreground, &err);
+        // the hashed file went away, it may be elsewhere in $PATH now
+        if(err == ENOENT && access(path, F_OK) != 0 && (path = rehash_cmd(cur_node->args->val[0]))) {
+            pid = spawn_cmd(cur_node, path, in_fd, out_fd, pgid, foreground, &err);
+        }
     }
+    if(err == ENOEXEC) {
+        pid = fork_cmd(cur_node, in_fd, out_fd, pgid, foreground);
+    } else if(err) {
+        fprintf(stderr, "error shell: %s: %s\n", cur_node->args->val[0], strerror(err));
+    }
+    // like sh: not found or found but can't run
+    *status = err == ENOENT ? 127 : 126;
+    return pid;
 }
 
-void run_cmd(NodeList *list) {
+/* run one pipeline as a job, its status is the one of the last stage, a background one isn't waited for */
+int run_pipeline(NodeList *list, bool background) {
     IS_EXECUTING = true;
-    /* init pipe */
-    // cur pipe for child to process
-    int pipes[PIPE_SIZE][2] = {0};
-    pid_t pid[PIPE_SIZE] = {0};
+    // read end of the pipe from the previous stage, -1 for the first one
+    int in_fd = -1;
+    Job *job = new_job(list, list, list->len);
 
     int cmd_idx = 0;
 
     Node *cur_node = list->begin;
 
     while(cur_node) {
-        /* built-it function */
-        if(strcmp("exit", cur_node->args->val[0]) == 0) {
-            exit(0);
-        } else if(strcmp("cd", cur_node->args->val[0]) == 0) {
-            cd(cur_node->args->val[1]);
-            cmd_idx++;
-            cur_node = cur_node->next;
-            continue;
-        }
-
-        /* normal cmd */
-        pipe(pipes[cmd_idx]);
-        pid[cmd_idx]= fork();
-
-        if(pid[cmd_idx] < 0) {
-            // error forking
+        expand_node(cur_node);
+        int pipes[2] = {-1, -1};
+        if(cur_node->next && pipe2(pipes, O_CLOEXEC) != 0) {
             perror("error shell");
-        } else if(pid[cmd_idx] != 0) {
-            // parent process
-            close(pipes[cmd_idx][WRITE]);
-            int status;
-            // warning: avoid closing wrong pipe
-            if(!cmd_idx) {
-                // close(pipes[cmd_idx-1][READ]);
-            }
-        } else {
-            // child process
-            // set ctrl-c handler
-            signal(SIGINT, sigint_kill_handler);
-            // Child process
-            close(pipes[cmd_idx][READ]);
-            // warning: redirection has higher priority than pipe
-            if(cmd_idx) {
-                dup2(pipes[cmd_idx-1][READ], STDIN_FILENO);
-                close(pipes[cmd_idx-1][READ]);
-            }
-            if(cur_node->next) {
-                dup2(pipes[cmd_idx][WRITE], STDOUT_FILENO);
+            break;
+        }
+        // warning: redirection has higher priority than pipe
+        int redir_in, redir_out;
+        if(open_redirs(cur_node, &redir_in, &redir_out)) {
+            int stage_in = redir_in >= 0 ? redir_in : in_fd;
+            int stage_out = redir_out >= 0 ? redir_out : pipes[WRITE];
+            BuiltinFunc builtin = find_builtin(cur_node->args->val[0]);
+            if(builtin && !cur_node->next && !background) {
+                set_job_proc(job, cmd_idx, 0, run_builtin_here(builtin, cur_node, stage_in, stage_out));
+            } else {
+                int status;
+                pid_t pid = start_stage(builtin, cur_node, stage_in, stage_out, job->pgid, !background, &status);
+                set_job_proc(job, cmd_idx, pid, status);
             }
-            close(pipes[cmd_idx][WRITE]);
-
-            // redirection
-            if(cur_node->in_path) {
-                int fd = open(cur_node->in_path, O_RDONLY);
-                dup2(fd, STDIN_FILENO);
+            if(redir_in >= 0) {
+                close(redir_in);
             }
-
-            if(cur_node->out_path) {
-
-                int fd;
-                if(cur_node->out_append) {
-                    fd = open(cur_node->out_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
-                } else {
-                    fd = open(cur_node->out_path, O_WRONLY | O_CREAT, 0644);
-                }
-                dup2(fd, STDOUT_FILENO);
+            if(redir_out >= 0) {
+                close(redir_out);
             }
+        } else {
+            // like a command that failed, the next stage still reads an empty pipe
+            set_job_proc(job, cmd_idx, 0, 1);
+        }
 
-            cur_node->args->val[cur_node->args->idx] = NULL;
-            // start execute
-            if (execvp(cur_node->args->val[0], cur_node->args->val) == -1) {
-                perror("error shell");
-            }
-            exit(0);
+        // parent process, the child has its own copies now
+        if(in_fd >= 0) {
+            close(in_fd);
+        }
+        if(pipes[WRITE] >= 0) {
+            close(pipes[WRITE]);
         }
+        in_fd = pipes[READ];
         cur_node = cur_node->next;
         cmd_idx++;
     }
-    // recover all subprocess and close pipe
-    for(int i=0; i<cmd_idx; i++) {
-        // close(pipes[i][READ]);
-        waitpid(pid[i], NULL, 0);
+    if(in_fd >= 0) {
+        close(in_fd);
+    }
+    // stages after a failed pipe never ran
+    for(; cmd_idx < list->len; cmd_idx++) {
+        set_job_proc(job, cmd_idx, 0, 1);
     }
 
-    if(IS_INTERACTIVE) {
-        print_bar();
+    int status = 0;
+    if(background) {
+        put_job_background(job);
+    } else {
+        status = wait_job(job);
     }
     IS_EXECUTING = false;
+    return status;
+}
+
+/*
+    run the and-or list from begin to end: a pipeline after && runs only
+    if the status so far is 0, after || only if it isn't. a skipped
+    pipeline keeps the status, so in a || b && c, c runs when a did.
+*/
+void run_and_or(NodeList *begin, NodeList *end) {
+    NodeList *cur = begin;
+    while(true) {
+        LAST_STATUS = run_pipeline(cur, false);
+        while(cur != end && (cur->sep == SEP_AND) != (LAST_STATUS == 0)) {
+            cur = cur->next;
+        }
+        if(cur == end) {
+            break;
+        }
+        cur = cur->next;
+    }
+}
+
+/* an and-or list ending with &, only one of several pipelines needs a shell of its own */
+void run_background(NodeList *begin, NodeList *end) {
+    if(begin == end) {
+        run_pipeline(begin, true);
+    } else {
+        fflush(stdout);
+        pid_t pid = fork();
+        if(pid < 0) {
+            perror("error shell");
+        } else if(pid == 0) {
+            if(IS_INTERACTIVE) {
+                setpgid(0, 0);
+                signal(SIGINT, SIG_DFL);
+                signal(SIGQUIT, SIG_DFL);
+                signal(SIGTSTP, SIG_DFL);
+                signal(SIGTTIN, SIG_DFL);
+                signal(SIGTTOU, SIG_DFL);
+            }
+            // no job control in the copy, its pipelines stay in its group
+            IS_INTERACTIVE = false;
+            forget_jobs();
+            run_and_or(begin, end);
+            exit(LAST_STATUS);
+        } else {
+            Job *job = new_job(begin, end, 1);
+            set_job_proc(job, 0, pid, 1);
+            put_job_background(job);
+        }
+    }
+    LAST_STATUS = 0;
+}
+
+/* run a line, its and-or lists one after another */
+void run_line(CmdList *line) {
+    reap_jobs();
+    NodeList *cur = line->begin;
+    while(cur) {
+        // the and-or list goes on up to the first ; or &
+        NodeList *end = cur;
+        while(end->sep == SEP_AND || end->sep == SEP_OR) {
+            end = end->next;
+        }
+        if(end->sep == SEP_BG) {
+            run_background(cur, end);
+        } else {
+            run_and_or(cur, end);
+        }
+        cur = end->next;
+    }
 }
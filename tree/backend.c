@@ -0,0 +1,284 @@
+#include "backend.h"
+
+/* sync backend */
+void run_sync(StatBatch *batch) {
+    struct statx stx;
+    for(int i = 0; i < batch->n; i++) {
+        int res = statx(batch->dir_fd, batch->name(batch->arg, i), batch->flags, batch->mask, &stx);
+        batch->done(batch->arg, i, res < 0 ? -errno : 0, &stx);
+    }
+    count_call(CALL_STATX, batch->n);
+}
+
+
+/*
+    thread backend
+    a batch is queued for the pool, every pool thread and the submitter
+    take the next index until the batch runs out.
+*/
+pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t batch_cond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t batch_done_cond = PTHREAD_COND_INITIALIZER;
+StatBatch *batch_queue = NULL;
+// several walks may ask for the pool, it is started once
+pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+void unlink_batch(StatBatch *batch) {
+    StatBatch **cur = &batch_queue;
+    while(*cur && *cur != batch) {
+        cur = &(*cur)->queue_next;
+    }
+    if(*cur) {
+        *cur = batch->queue_next;
+    }
+}
+
+void help_batch(StatBatch *batch) {
+    struct statx stx;
+    int i;
+    while((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->n) {
+        int res = statx(batch->dir_fd, batch->name(batch->arg, i), batch->flags, batch->mask, &stx);
+        batch->done(batch->arg, i, res < 0 ? -errno : 0, &stx);
+        count_call(CALL_STATX, 1);
+        __atomic_add_fetch(&batch->finished, 1, __ATOMIC_RELEASE);
+    }
+}
+
+void *stat_thread_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&batch_lock);
+    while(true) {
+        while(!batch_queue) {
+            pthread_cond_wait(&batch_cond, &batch_lock);
+        }
+        StatBatch *batch = batch_queue;
+        batch->helpers++;
+        pthread_mutex_unlock(&batch_lock);
+
+        help_batch(batch);
+
+        pthread_mutex_lock(&batch_lock);
+        // nothing left to hand out, later threads should not pick it up
+        unlink_batch(batch);
+        batch->helpers--;
+        pthread_cond_broadcast(&batch_done_cond);
+    }
+    return NULL;
+}
+
+void start_stat_pool() {
+    pthread_t tid;
+    for(int i = 0; i < STAT_POOL_SIZE; i++) {
+        if(pthread_create(&tid, NULL, stat_thread_main, NULL) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+        pthread_detach(tid);
+    }
+}
+
+void run_threads(StatBatch *batch) {
+    batch->next = batch->finished = batch->helpers = 0;
+    pthread_mutex_lock(&batch_lock);
+    batch->queue_next = batch_queue;
+    batch_queue = batch;
+    pthread_cond_broadcast(&batch_cond);
+    pthread_mutex_unlock(&batch_lock);
+
+    help_batch(batch);
+
+    // the batch lives on the caller's stack, wait for every helper to let go
+    pthread_mutex_lock(&batch_lock);
+    unlink_batch(batch);
+    while(batch->helpers || __atomic_load_n(&batch->finished, __ATOMIC_ACQUIRE) < batch->n) {
+        pthread_cond_wait(&batch_done_cond, &batch_lock);
+    }
+    pthread_mutex_unlock(&batch_lock);
+}
+
+
+/*
+    io_uring backend
+    every thread owns a ring and keeps up to URING_DEPTH statx in flight,
+    refilling the submission queue as completions come back.
+*/
+typedef struct Ring Ring;
+struct Ring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    char *ring_ptr;
+    size_t ring_size, sqes_size;
+    // slot -> entry index, and the statx buffer of every slot
+    int slot_idx[URING_DEPTH];
+    int free_slot[URING_DEPTH];
+    struct statx stx[URING_DEPTH];
+};
+
+__thread Ring *thread_ring = NULL;
+// closes the ring of a worker thread when it exits
+pthread_key_t ring_key;
+pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+void free_ring(void *arg) {
+    Ring *ring = arg;
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->ring_ptr, ring->ring_size);
+    close(ring->fd);
+    free(ring);
+}
+
+void make_ring_key() {
+    pthread_key_create(&ring_key, free_ring);
+}
+
+Ring *new_ring() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(SYS_io_uring_setup, URING_DEPTH, &params);
+    if(fd < 0) {
+        return NULL;
+    }
+    if(!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(fd);
+        return NULL;
+    }
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ring_size = sq_size > cq_size ? sq_size : cq_size;
+    size_t sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    char *ring_ptr = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd, IORING_OFF_SQ_RING);
+    struct io_uring_sqe *sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(ring_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    Ring *ring = calloc(1, sizeof(Ring));
+    ring->fd = fd;
+    ring->ring_ptr = ring_ptr;
+    ring->ring_size = ring_size;
+    ring->sqes_size = sqes_size;
+    ring->sq_head = (unsigned *)(ring_ptr + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(ring_ptr + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(ring_ptr + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(ring_ptr + params.sq_off.array);
+    ring->cq_head = (unsigned *)(ring_ptr + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(ring_ptr + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(ring_ptr + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(ring_ptr + params.cq_off.cqes);
+    ring->sqes = sqes;
+    for(int i = 0; i < URING_DEPTH; i++) {
+        ring->free_slot[i] = i;
+    }
+    pthread_once(&ring_key_once, make_ring_key);
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+/* ask the kernel if it knows IORING_OP_STATX (5.6+) */
+bool ring_supports_statx(Ring *ring) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    bool result = false;
+    if(syscall(SYS_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        result = probe->last_op >= IORING_OP_STATX &&
+                 (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return result;
+}
+
+void run_uring(StatBatch *batch) {
+    Ring *ring = thread_ring;
+    if(!ring) {
+        ring = thread_ring = new_ring();
+        if(!ring) {
+            run_sync(batch);
+            return;
+        }
+    }
+
+    int submitted = 0, completed = 0, inflight = 0;
+    while(completed < batch->n) {
+        // fill the submission queue
+        unsigned tail = *ring->sq_tail;
+        int to_submit = 0;
+        while(inflight < URING_DEPTH && submitted < batch->n) {
+            int slot = ring->free_slot[URING_DEPTH - 1 - inflight];
+            unsigned idx = tail & *ring->sq_mask;
+            struct io_uring_sqe *sqe = &ring->sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = batch->dir_fd;
+            sqe->addr = (unsigned long)batch->name(batch->arg, submitted);
+            sqe->len = batch->mask;
+            sqe->off = (unsigned long)&ring->stx[slot];
+            sqe->statx_flags = batch->flags;
+            sqe->user_data = slot;
+            ring->sq_array[idx] = idx;
+            ring->slot_idx[slot] = submitted;
+            tail++;
+            to_submit++;
+            submitted++;
+            inflight++;
+        }
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+        int ret = syscall(SYS_io_uring_enter, ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        count_call(CALL_URING_ENTER, 1);
+        count_call(CALL_URING_STATX, to_submit);
+        if(ret < 0 && errno != EINTR) {
+            perror("io_uring_enter");
+            exit(1);
+        }
+
+        // reap every completion that is ready
+        unsigned head = *ring->cq_head;
+        while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            int slot = cqe->user_data;
+            batch->done(batch->arg, ring->slot_idx[slot], cqe->res, &ring->stx[slot]);
+            head++;
+            inflight--;
+            completed++;
+            ring->free_slot[URING_DEPTH - 1 - inflight] = slot;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+
+/* public function */
+
+/* prepare backend and return the one that will actually be used */
+int init_backend(int backend) {
+    if(backend == BACKEND_URING) {
+        // a later walk from the same thread reuses the ring
+        Ring *ring = thread_ring ? thread_ring : new_ring();
+        if(ring && ring_supports_statx(ring)) {
+            thread_ring = ring;
+            return BACKEND_URING;
+        }
+        fprintf(stderr, "my_tree: io_uring statx unavailable, using threads\n");
+        backend = BACKEND_THREADS;
+    }
+    if(backend == BACKEND_THREADS) {
+        pthread_once(&pool_once, start_stat_pool);
+    }
+    return backend;
+}
+
+void run_stat_batch(int backend, StatBatch *batch) {
+    if(backend == BACKEND_SYNC || batch->n < MIN_BATCH) {
+        run_sync(batch);
+    } else if(backend == BACKEND_THREADS) {
+        run_threads(batch);
+    } else {
+        run_uring(batch);
+    }
+}
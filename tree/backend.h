@@ -0,0 +1,50 @@
+#ifndef _BACKEND_H
+#define _BACKEND_H
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "stats.h"
+
+/* how the entries of one directory get stat'ed */
+enum Backend {
+    BACKEND_SYNC,
+    BACKEND_THREADS,
+    BACKEND_URING
+};
+
+#define STAT_POOL_SIZE 16
+#define URING_DEPTH 128
+// not worth waking the pool up for fewer entries
+#define MIN_BATCH 4
+
+/* statx for entry 0 .. n - 1 of one directory, done() is called once per entry */
+typedef struct StatBatch StatBatch;
+struct StatBatch {
+    int dir_fd, flags;
+    unsigned int mask;
+    int n;
+    const char *(*name)(void *arg, int idx);
+    void (*done)(void *arg, int idx, int res, struct statx *stx);
+    void *arg;
+
+    // progress, shared with the thread pool
+    int next, finished, helpers;
+    StatBatch *queue_next;
+};
+
+int init_backend(int backend);
+void run_stat_batch(int backend, StatBatch *batch);
+
+#endif
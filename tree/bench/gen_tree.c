@@ -0,0 +1,197 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/*
+    synthetic hierarchies for run_bench, every shape is generated from a
+    fixed seed so two runs on the same scale give the same tree.
+
+    gen_tree <dir> <wide|deep|links|mixed> [scale]
+    dir is created if needed, its parent has to exist
+*/
+
+#define NAME_SIZE 64
+
+/* private global var */
+uint64_t rng = 0x9e3779b97f4a7c15ULL;
+long long made = 0;
+
+uint64_t next_rand() {
+    // xorshift64
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+/* lower case name of 4 .. 4 + spread - 1 bytes, prefixed so names never clash */
+void rand_name(char *buf, int idx, int spread) {
+    int len = 4 + next_rand() % spread;
+    int off = sprintf(buf, "%x_", idx);
+    for(int i = 0; i < len; i++) {
+        buf[off + i] = 'a' + next_rand() % 26;
+    }
+    buf[off + len] = '\0';
+}
+
+void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+int make_dir(int parent, const char *name) {
+    if(mkdirat(parent, name, 0755) != 0 && errno != EEXIST) {
+        die("mkdirat");
+    }
+    int fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0) {
+        die("openat");
+    }
+    made++;
+    return fd;
+}
+
+/* sparse file, the size only shows up in the summary and --du */
+void make_file(int dir, const char *name, off_t size, mode_t mode) {
+    int fd = openat(dir, name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if(fd < 0) {
+        die("openat");
+    }
+    if(size && ftruncate(fd, size) != 0) {
+        die("ftruncate");
+    }
+    close(fd);
+    made++;
+}
+
+void make_link(int dir, const char *target, const char *name) {
+    if(symlinkat(target, dir, name) != 0 && errno != EEXIST) {
+        die("symlinkat");
+    }
+    made++;
+}
+
+/* one directory holding 100k files with random names, stresses sort and getdents */
+void gen_wide(int root, int scale) {
+    char name[NAME_SIZE];
+    for(int i = 0; i < 100000 * scale; i++) {
+        rand_name(name, i, 20);
+        make_file(root, name, 0, 0644);
+    }
+}
+
+/* 8 chains of 250 nested directories, 3 files on every level */
+void gen_deep(int root, int scale) {
+    char name[NAME_SIZE];
+    for(int c = 0; c < 8; c++) {
+        sprintf(name, "chain%d", c);
+        int dir = make_dir(root, name);
+        for(int d = 0; d < 250 * scale; d++) {
+            for(int f = 0; f < 3; f++) {
+                rand_name(name, f, 8);
+                make_file(dir, name, next_rand() % 4096, 0644);
+            }
+            int sub = make_dir(dir, "level");
+            close(dir);
+            dir = sub;
+        }
+        close(dir);
+    }
+}
+
+/* 20 directories of 1000 symlinks to files, directories and nowhere */
+void gen_links(int root, int scale) {
+    char name[NAME_SIZE], target[NAME_SIZE * 2];
+    int base = make_dir(root, "targets");
+    for(int i = 0; i < 100; i++) {
+        sprintf(name, "file%d", i);
+        make_file(base, name, i * 100, 0644);
+        sprintf(name, "dir%d", i);
+        close(make_dir(base, name));
+    }
+    close(base);
+    for(int d = 0; d < 20 * scale; d++) {
+        sprintf(name, "links%d", d);
+        int dir = make_dir(root, name);
+        for(int i = 0; i < 1000; i++) {
+            int kind = next_rand() % 3;
+            if(kind == 0) {
+                sprintf(target, "../targets/file%d", (int)(next_rand() % 100));
+            } else if(kind == 1) {
+                sprintf(target, "../targets/dir%d", (int)(next_rand() % 100));
+            } else {
+                rand_name(target, i, 40);
+            }
+            rand_name(name, i, 12);
+            make_link(dir, target, name);
+        }
+        close(dir);
+    }
+}
+
+/* fan out of 8 for 4 levels, 30 files per directory with sizes from 0 to 64M */
+void gen_mixed_dir(int dir, int level, int scale) {
+    char name[NAME_SIZE], prev[NAME_SIZE];
+    for(int i = 0; i < 30 * scale; i++) {
+        rand_name(name, i, 12);
+        // log uniform, most files are small
+        off_t size = next_rand() % 27 ? (off_t)(next_rand() % (1ULL << (next_rand() % 27))) : 0;
+        if(i % 10 == 9) {
+            // points at the file made just before
+            make_link(dir, prev, strcat(name, ".lnk"));
+        } else {
+            make_file(dir, name, size, i % 7 == 0 ? 0755 : 0644);
+            strcpy(prev, name);
+        }
+    }
+    if(level == 4) {
+        return;
+    }
+    for(int i = 0; i < 8; i++) {
+        rand_name(name, i, 8);
+        int sub = make_dir(dir, name);
+        gen_mixed_dir(sub, level + 1, scale);
+        close(sub);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s dir wide|deep|links|mixed [scale]\n", argv[0]);
+        exit(1);
+    }
+    int scale = argc > 3 ? atoi(argv[3]) : 1;
+    if(scale < 1) {
+        fprintf(stderr, "gen_tree: invalid scale: %s\n", argv[3]);
+        exit(1);
+    }
+    if(mkdir(argv[1], 0755) != 0 && errno != EEXIST) {
+        die(argv[1]);
+    }
+    int root = open(argv[1], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(root < 0) {
+        die(argv[1]);
+    }
+    if(strcmp(argv[2], "wide") == 0) {
+        gen_wide(root, scale);
+    } else if(strcmp(argv[2], "deep") == 0) {
+        gen_deep(root, scale);
+    } else if(strcmp(argv[2], "links") == 0) {
+        gen_links(root, scale);
+    } else if(strcmp(argv[2], "mixed") == 0) {
+        gen_mixed_dir(root, 1, scale);
+    } else {
+        fprintf(stderr, "gen_tree: unknown shape: %s\n", argv[2]);
+        exit(1);
+    }
+    close(root);
+    printf("%s: %lld entries\n", argv[1], made);
+}
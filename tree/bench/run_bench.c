@@ -0,0 +1,326 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/ptrace.h>
+#include <linux/ptrace.h>
+
+/*
+    run my_tree over the trees made by gen_tree and compare with a baseline
+
+    run_bench [-r runs] [-b baseline.json] [-u] my_tree dir shape...
+
+    every (shape, mode) pair is run `runs` times with stdout on /dev/null,
+    wall time is the median and peak RSS the maximum over the runs. one more
+    run under ptrace counts the syscalls entered by every thread.
+*/
+
+#define MAX_ARGS 8
+#define MAX_RESULTS 256
+#define DEFAULT_RUNS 5
+// worse than this against the baseline is reported as a regression
+#define WALL_SLACK 0.10
+#define RSS_SLACK 0.10
+#define SYSCALL_SLACK 0.02
+
+typedef struct Mode Mode;
+struct Mode {
+    const char *name;
+    const char *args[MAX_ARGS];
+};
+
+/* every mode runs without colour, the hot path is the same */
+Mode modes[] = {
+    {"default", {NULL}},
+    {"unsorted", {"-U", NULL}},
+    {"jobs4", {"-j", "4", NULL}},
+    {"threads", {"--backend=threads", NULL}},
+    {"uring", {"--backend=uring", NULL}},
+    {"du", {"--du", NULL}},
+    {"ndjson", {"--format=ndjson", NULL}}
+};
+
+typedef struct Result Result;
+struct Result {
+    char shape[32], mode[32];
+    long long entries, syscalls;
+    double wall_ms;
+    long maxrss_kb;
+};
+
+/* private global var */
+Result baseline[MAX_RESULTS];
+int baseline_top = 0;
+Result results[MAX_RESULTS];
+int results_top = 0;
+
+double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* fork my_tree in dir, its stdout goes to out_fd */
+pid_t spawn(const char *tree, const char *dir, Mode *mode, int out_fd, bool traced) {
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if(pid > 0) {
+        return pid;
+    }
+    const char *argv[MAX_ARGS + 3] = {tree, "-n"};
+    int argc = 2;
+    for(int i = 0; mode->args[i]; i++) {
+        argv[argc++] = mode->args[i];
+    }
+    argv[argc] = NULL;
+    if(chdir(dir) != 0) {
+        perror(dir);
+        _exit(1);
+    }
+    dup2(out_fd, STDOUT_FILENO);
+    if(traced) {
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        // let the tracer set its options before exec
+        raise(SIGSTOP);
+    }
+    execv(tree, (char **)argv);
+    perror(tree);
+    _exit(1);
+}
+
+int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* entries in the tree, read from the summary line of one plain run */
+long long count_entries(const char *tree, const char *dir) {
+    int pipe_fd[2];
+    if(pipe(pipe_fd) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+    pid_t pid = spawn(tree, dir, &modes[0], pipe_fd[1], false);
+    close(pipe_fd[1]);
+    FILE *out = fdopen(pipe_fd[0], "r");
+    char line[4096];
+    long long dirs = 0, files = 0, links = 0;
+    while(fgets(line, sizeof(line), out)) {
+        sscanf(line, "%lld directories, %lld files, %lld soft links", &dirs, &files, &links);
+    }
+    fclose(out);
+    waitpid(pid, NULL, 0);
+    return dirs + files + links;
+}
+
+/* follow every thread of the child, count syscall entry stops */
+long long count_syscalls(const char *tree, const char *dir, Mode *mode, int null_fd) {
+    pid_t pid = spawn(tree, dir, mode, null_fd, true);
+    int status;
+    waitpid(pid, &status, 0);
+    ptrace(PTRACE_SETOPTIONS, pid, NULL,
+           PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+
+    long long count = 0;
+    pid_t tid;
+    while((tid = waitpid(-1, &status, __WALL)) > 0) {
+        if(WIFEXITED(status) || WIFSIGNALED(status)) {
+            continue;
+        }
+        int sig = 0;
+        if(WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+            struct ptrace_syscall_info info;
+            if(ptrace(PTRACE_GET_SYSCALL_INFO, tid, sizeof(info), &info) > 0 &&
+               info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+                count++;
+            }
+        } else if(status >> 16) {
+            // clone event, the new thread reports its own SIGSTOP
+        } else if(WSTOPSIG(status) != SIGSTOP && WSTOPSIG(status) != SIGTRAP) {
+            sig = WSTOPSIG(status);
+        }
+        ptrace(PTRACE_SYSCALL, tid, NULL, sig);
+    }
+    return count;
+}
+
+void run_mode(const char *tree, const char *dir, const char *shape, Mode *mode,
+              long long entries, int runs, int null_fd) {
+    Result *res = &results[results_top++];
+    memset(res, 0, sizeof(Result));
+    snprintf(res->shape, sizeof(res->shape), "%s", shape);
+    snprintf(res->mode, sizeof(res->mode), "%s", mode->name);
+    res->entries = entries;
+
+    double wall[runs];
+    for(int i = 0; i < runs; i++) {
+        double start = now_ms();
+        pid_t pid = spawn(tree, dir, mode, null_fd, false);
+        int status;
+        struct rusage usage;
+        wait4(pid, &status, 0, &usage);
+        wall[i] = now_ms() - start;
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "run_bench: %s %s failed\n", shape, mode->name);
+        }
+        if(usage.ru_maxrss > res->maxrss_kb) {
+            res->maxrss_kb = usage.ru_maxrss;
+        }
+    }
+    qsort(wall, runs, sizeof(double), cmp_double);
+    res->wall_ms = wall[runs / 2];
+
+    // tracing slows everything down, it gets a run of its own
+    res->syscalls = count_syscalls(tree, dir, mode, null_fd);
+}
+
+/* one result per line, as written by write_baseline */
+void read_baseline(const char *path) {
+    FILE *file = fopen(path, "r");
+    if(!file) {
+        return;
+    }
+    char line[512];
+    while(baseline_top < MAX_RESULTS && fgets(line, sizeof(line), file)) {
+        Result *res = &baseline[baseline_top];
+        if(sscanf(line, " {\"shape\": \"%31[^\"]\", \"mode\": \"%31[^\"]\", \"entries\": %lld,"
+                        " \"wall_ms\": %lf, \"syscalls\": %lld, \"maxrss_kb\": %ld",
+                  res->shape, res->mode, &res->entries, &res->wall_ms,
+                  &res->syscalls, &res->maxrss_kb) == 6) {
+            baseline_top++;
+        }
+    }
+    fclose(file);
+}
+
+void write_baseline(const char *path) {
+    FILE *file = fopen(path, "w");
+    if(!file) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(file, "[\n");
+    for(int i = 0; i < results_top; i++) {
+        Result *res = &results[i];
+        fprintf(file, "  {\"shape\": \"%s\", \"mode\": \"%s\", \"entries\": %lld,"
+                      " \"wall_ms\": %.2f, \"syscalls\": %lld, \"maxrss_kb\": %ld,"
+                      " \"entries_per_s\": %.0f}%s\n",
+                res->shape, res->mode, res->entries, res->wall_ms, res->syscalls,
+                res->maxrss_kb, res->entries / res->wall_ms * 1e3,
+                i == results_top - 1 ? "" : ",");
+    }
+    fprintf(file, "]\n");
+    fclose(file);
+}
+
+Result *find_baseline(Result *res) {
+    for(int i = 0; i < baseline_top; i++) {
+        if(strcmp(baseline[i].shape, res->shape) == 0 && strcmp(baseline[i].mode, res->mode) == 0) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+/* "+12.3%" of cur against old, with a '!' past the allowed slack */
+bool print_delta(double cur, double old, double slack) {
+    if(old <= 0) {
+        printf(" %9s", "-");
+        return false;
+    }
+    double delta = (cur - old) / old;
+    bool worse = delta > slack;
+    printf(" %+8.1f%%%s", delta * 100, worse ? "!" : " ");
+    return worse;
+}
+
+int report() {
+    int regressions = 0;
+    printf("%-6s %-9s %8s %10s %12s %10s %10s   %10s %10s %10s\n", "shape", "mode", "entries",
+           "wall ms", "entries/s", "syscalls", "rss KB", "wall", "syscalls", "rss");
+    for(int i = 0; i < results_top; i++) {
+        Result *res = &results[i];
+        printf("%-6s %-9s %8lld %10.2f %12.0f %10lld %10ld  ", res->shape, res->mode,
+               res->entries, res->wall_ms, res->entries / res->wall_ms * 1e3,
+               res->syscalls, res->maxrss_kb);
+        Result *old = find_baseline(res);
+        if(old) {
+            bool worse = print_delta(res->wall_ms, old->wall_ms, WALL_SLACK);
+            worse |= print_delta(res->syscalls, old->syscalls, SYSCALL_SLACK);
+            worse |= print_delta(res->maxrss_kb, old->maxrss_kb, RSS_SLACK);
+            regressions += worse;
+        }
+        printf("\n");
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[]) {
+    int runs = DEFAULT_RUNS, opt;
+    char *baseline_path = NULL;
+    bool update = false;
+    while((opt = getopt(argc, argv, "r:b:u")) != -1) {
+        switch(opt) {
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            case 'b':
+                baseline_path = optarg;
+                break;
+            case 'u':
+                update = true;
+                break;
+            default:
+                runs = 0;
+        }
+    }
+    if(runs < 1 || argc - optind < 3) {
+        fprintf(stderr, "usage: %s [-r runs] [-b baseline.json] [-u] my_tree dir shape...\n", argv[0]);
+        exit(1);
+    }
+    // exec'ed from the shape directory
+    char *tree = realpath(argv[optind], NULL);
+    if(!tree) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    const char *root = argv[optind + 1];
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if(baseline_path) {
+        read_baseline(baseline_path);
+    }
+
+    char dir[4096];
+    for(int i = optind + 2; i < argc; i++) {
+        snprintf(dir, sizeof(dir), "%s/%s", root, argv[i]);
+        long long entries = count_entries(tree, dir);
+        for(size_t m = 0; m < sizeof(modes) / sizeof(Mode) && results_top < MAX_RESULTS; m++) {
+            run_mode(tree, dir, argv[i], &modes[m], entries, runs, null_fd);
+        }
+    }
+
+    int regressions = report();
+    if(update && baseline_path) {
+        write_baseline(baseline_path);
+        printf("\nbaseline written to %s\n", baseline_path);
+    } else if(baseline_top) {
+        printf("\n%d regression%s against %s ('!' = worse than %.0f%% wall, %.0f%% syscalls,"
+               " %.0f%% rss)\n", regressions, regressions == 1 ? "" : "s", baseline_path,
+               WALL_SLACK * 100, SYSCALL_SLACK * 100, RSS_SLACK * 100);
+    }
+    free(tree);
+}
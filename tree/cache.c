@@ -0,0 +1,180 @@
+#include "cache.h"
+
+int cmp_key(const void *a, const void *b) {
+    const CacheKey *x = a, *y = b;
+    if(x->dev != y->dev) {
+        return x->dev < y->dev ? -1 : 1;
+    }
+    if(x->ino != y->ino) {
+        return x->ino < y->ino ? -1 : 1;
+    }
+    return 0;
+}
+
+void map_old_cache(Cache *cache) {
+    int fd = open(cache->path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return;
+    }
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(CacheHeader)) {
+        cache->old_size = st.st_size;
+        cache->old_map = mmap(NULL, cache->old_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(cache->old_map == MAP_FAILED) {
+            cache->old_map = NULL;
+        }
+    }
+    close(fd);
+    if(!cache->old_map) {
+        return;
+    }
+
+    // anything written by another version or with other options is ignored
+    CacheHeader *old = (CacheHeader *)cache->old_map;
+    CacheHeader *header = &cache->header;
+    if(memcmp(old->magic, header->magic, sizeof(header->magic)) != 0 ||
+       old->version != header->version || old->entry_size != header->entry_size ||
+       old->flags != header->flags || old->table_off > cache->old_size ||
+       // every term on its own, a hostile count must not wrap the sum
+       old->dir_count > (cache->old_size - old->table_off) / sizeof(CacheKey)) {
+        munmap(cache->old_map, cache->old_size);
+        cache->old_map = NULL;
+        return;
+    }
+    cache->old_keys = (CacheKey *)(cache->old_map + old->table_off);
+    cache->old_count = old->dir_count;
+}
+
+void write_cache(Cache *cache, void *buf, size_t len) {
+    // an empty listing has no names buffer at all
+    if(!len) {
+        return;
+    }
+    if(cache->new_file && fwrite(buf, 1, len, cache->new_file) != len) {
+        perror("my_tree: cache");
+        fclose(cache->new_file);
+        unlink(cache->tmp_path);
+        cache->new_file = NULL;
+    }
+    cache->new_off += len;
+}
+
+
+/* public function */
+Cache *open_cache(const char *path, uint32_t entry_size, uint64_t flags) {
+    Cache *cache = calloc(1, sizeof(Cache));
+    if(!cache) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    memcpy(cache->header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    cache->header.version = CACHE_VERSION;
+    cache->header.entry_size = entry_size;
+    cache->header.flags = flags;
+    cache->start_time = time(NULL);
+    pthread_mutex_init(&cache->lock, NULL);
+
+    cache->path = strdup(path);
+    cache->tmp_path = malloc(strlen(path) + 5);
+    if(!cache->path || !cache->tmp_path) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    sprintf(cache->tmp_path, "%s.tmp", path);
+    map_old_cache(cache);
+
+    cache->new_file = fopen(cache->tmp_path, "w");
+    if(!cache->new_file) {
+        perror("my_tree: cache");
+        close_cache(cache);
+        return NULL;
+    }
+    // the header is rewritten at close once the table offset is known
+    write_cache(cache, &cache->header, sizeof(cache->header));
+    return cache;
+}
+
+/* cached listing of the directory, NULL if unknown or modified since */
+CacheDir *lookup_cache(Cache *cache, CacheDir *key) {
+    if(!cache->old_map) {
+        return NULL;
+    }
+    CacheKey target = {key->dev, key->ino, 0};
+    CacheKey *found = bsearch(&target, cache->old_keys, cache->old_count, sizeof(CacheKey), cmp_key);
+    if(!found || found->off > cache->old_size || cache->old_size - found->off < sizeof(CacheDir)) {
+        return NULL;
+    }
+    CacheDir *dir = (CacheDir *)(cache->old_map + found->off);
+    if(dir->mtime_sec != key->mtime_sec || dir->mtime_nsec != key->mtime_nsec) {
+        return NULL;
+    }
+    // what is left after the header, each part is checked on its own so nothing wraps
+    uint64_t left = cache->old_size - found->off - sizeof(CacheDir);
+    uint64_t entries_len = (uint64_t)dir->n * cache->header.entry_size;
+    if(entries_len > left || dir->names_len > left - entries_len) {
+        return NULL;
+    }
+    return dir;
+}
+
+void *cache_entries(CacheDir *dir) {
+    return (char *)dir + sizeof(CacheDir);
+}
+
+char *cache_names(CacheDir *dir, uint32_t entry_size) {
+    return (char *)cache_entries(dir) + (size_t)dir->n * entry_size;
+}
+
+/* append a listing, key->n and key->names_len give the sizes */
+void store_cache(Cache *cache, CacheDir *key, void *entries, char *names) {
+    // a directory changed within the last second may change again unnoticed
+    if(key->mtime_sec + 1 >= cache->start_time) {
+        return;
+    }
+    static const char pad[8];
+    pthread_mutex_lock(&cache->lock);
+    if(!cache->new_file) {
+        pthread_mutex_unlock(&cache->lock);
+        return;
+    }
+    if(cache->new_count == cache->new_capacity) {
+        cache->new_capacity = cache->new_capacity ? cache->new_capacity * 2 : 1024;
+        cache->new_keys = realloc(cache->new_keys, sizeof(CacheKey) * cache->new_capacity);
+        if(!cache->new_keys) {
+            perror("Memory leak!");
+            exit(1);
+        }
+    }
+    cache->new_keys[cache->new_count++] = (CacheKey){key->dev, key->ino, cache->new_off};
+    write_cache(cache, key, sizeof(CacheDir));
+    write_cache(cache, entries, (size_t)key->n * cache->header.entry_size);
+    write_cache(cache, names, key->names_len);
+    write_cache(cache, (void *)pad, (8 - cache->new_off % 8) % 8);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* write the table and move the new index over the old one */
+void close_cache(Cache *cache) {
+    if(cache->new_file) {
+        qsort(cache->new_keys, cache->new_count, sizeof(CacheKey), cmp_key);
+        cache->header.dir_count = cache->new_count;
+        cache->header.table_off = cache->new_off;
+        write_cache(cache, cache->new_keys, sizeof(CacheKey) * cache->new_count);
+    }
+    if(cache->new_file) {
+        rewind(cache->new_file);
+        write_cache(cache, &cache->header, sizeof(cache->header));
+    }
+    if(cache->new_file && (fclose(cache->new_file) != 0 || rename(cache->tmp_path, cache->path) != 0)) {
+        perror("my_tree: cache");
+        unlink(cache->tmp_path);
+    }
+    if(cache->old_map) {
+        munmap(cache->old_map, cache->old_size);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->new_keys);
+    free(cache->path);
+    free(cache->tmp_path);
+    free(cache);
+}
@@ -0,0 +1,78 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "MYTREE1"
+#define CACHE_VERSION 2
+
+/*
+    on disk index, written to <path>.tmp and renamed over <path> at exit
+
+    CacheHeader
+    CacheDir, entries, names (8 byte aligned), repeated for every directory
+    CacheKey table sorted by (dev, ino)
+*/
+typedef struct CacheHeader CacheHeader;
+struct CacheHeader {
+    char magic[8];
+    uint32_t version, entry_size;
+    // listings depend on whether hidden files are skipped, the order, the
+    // statx mask and the -P/-I patterns
+    uint64_t flags;
+    uint64_t dir_count, table_off;
+};
+
+typedef struct CacheDir CacheDir;
+struct CacheDir {
+    uint64_t dev, ino;
+    int64_t mtime_sec;
+    uint32_t mtime_nsec;
+    // number of entries and bytes of names following them
+    uint32_t n;
+    uint64_t names_len;
+};
+
+typedef struct CacheKey CacheKey;
+struct CacheKey {
+    uint64_t dev, ino, off;
+};
+
+/* one open index, the previous run read and this run written */
+typedef struct Cache Cache;
+struct Cache {
+    // index of the previous run, mapped read only
+    char *old_map;
+    size_t old_size;
+    CacheKey *old_keys;
+    uint64_t old_count;
+
+    // index of this run
+    pthread_mutex_t lock;
+    char *path, *tmp_path;
+    FILE *new_file;
+    uint64_t new_off;
+    CacheKey *new_keys;
+    uint64_t new_count, new_capacity;
+    CacheHeader header;
+    time_t start_time;
+};
+
+Cache *open_cache(const char *path, uint32_t entry_size, uint64_t flags);
+CacheDir *lookup_cache(Cache *cache, CacheDir *key);
+void *cache_entries(CacheDir *dir);
+char *cache_names(CacheDir *dir, uint32_t entry_size);
+void store_cache(Cache *cache, CacheDir *key, void *entries, char *names);
+void close_cache(Cache *cache);
+
+#endif
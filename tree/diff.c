@@ -0,0 +1,184 @@
+#include "diff.h"
+
+#define CHANGE_TYPE 1
+#define CHANGE_MODE 2
+#define CHANGE_SIZE 4
+#define CHANGE_MTIME 8
+#define CHANGE_TARGET 16
+
+/* private global var */
+bool diff_color = false;
+// path of the last line printed, its directories are on screen already
+char *shown = NULL;
+size_t shown_len = 0, shown_capacity = 0;
+
+
+/* walk order: a directory comes right before everything below it */
+int cmp_walk_order(const Record *a, const Record *b) {
+    size_t n = a->path_len < b->path_len ? a->path_len : b->path_len;
+    for(size_t i = 0; i < n; i++) {
+        if(a->path[i] != b->path[i]) {
+            // '/' ends a name, so it goes before any byte of a longer name
+            if(a->path[i] == '/') {
+                return -1;
+            } else if(b->path[i] == '/') {
+                return 1;
+            }
+            return (unsigned char)a->path[i] < (unsigned char)b->path[i] ? -1 : 1;
+        }
+    }
+    return a->path_len < b->path_len ? -1 : a->path_len > b->path_len;
+}
+
+void set_shown(const char *path, size_t len) {
+    if(len > shown_capacity) {
+        char *new_ptr = realloc(shown, len);
+        if(!new_ptr) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        shown = new_ptr;
+        shown_capacity = len;
+    }
+    memcpy(shown, path, len);
+    shown_len = len;
+}
+
+/* marker, indent for depth and the coloured name */
+void print_name(char marker, const char *color, int depth, const char *name, size_t len) {
+    out_char(marker);
+    out_char(' ');
+    for(int i = 0; i < depth; i++) {
+        out_str("    ");
+    }
+    if(diff_color && color) {
+        out_str(color);
+        out_write(name, len);
+        out_str(COLOR_RESET);
+    } else {
+        out_write(name, len);
+    }
+}
+
+/* print the directories above path that are not on screen yet */
+void show_parents(const char *path, size_t len) {
+    size_t start = 0;
+    int depth = 0;
+    for(size_t end = 0; end < len; end++) {
+        if(path[end] != '/') {
+            continue;
+        }
+        if(shown_len < end || memcmp(shown, path, end) != 0 ||
+           (shown_len > end && shown[end] != '/')) {
+            print_name(' ', NULL, depth, path + start, end - start);
+            out_char('\n');
+        }
+        start = end + 1;
+        depth++;
+    }
+    set_shown(path, len);
+}
+
+/* one added, removed or modified entry, changes = 0 unless modified */
+void print_record(char marker, const char *color, Record *rec, Record *old, int changes) {
+    show_parents(rec->path, rec->path_len);
+    const char *name = rec->path;
+    int depth = 0;
+    for(size_t i = 0; i < rec->path_len; i++) {
+        if(rec->path[i] == '/') {
+            name = rec->path + i + 1;
+            depth++;
+        }
+    }
+    print_name(marker, color, depth, name, rec->path_len - (name - rec->path));
+    if(rec->link) {
+        out_str(" -> ");
+        out_str(rec->link);
+    }
+    if(changes) {
+        const char *sep = "  [";
+        if(changes & CHANGE_TYPE) {
+            out_printf("%stype", sep);
+            sep = ", ";
+        }
+        if(changes & CHANGE_MODE) {
+            out_printf("%smode %04o -> %04o", sep, (unsigned int)(old->mode & 07777),
+                       (unsigned int)(rec->mode & 07777));
+            sep = ", ";
+        }
+        if(changes & CHANGE_SIZE) {
+            out_printf("%ssize %llu -> %llu", sep, (unsigned long long)old->size,
+                       (unsigned long long)rec->size);
+            sep = ", ";
+        }
+        if(changes & CHANGE_MTIME) {
+            out_printf("%smtime", sep);
+            sep = ", ";
+        }
+        if(changes & CHANGE_TARGET) {
+            out_printf("%swas -> ", sep);
+            out_str(old->link);
+        }
+        out_char(']');
+    }
+    out_char('\n');
+}
+
+/* what differs between two entries at the same path */
+int record_changes(Record *old, Record *new) {
+    int changes = 0;
+    if((old->mode ^ new->mode) & S_IFMT) {
+        return CHANGE_TYPE;
+    }
+    if((old->mode ^ new->mode) & 07777) {
+        changes |= CHANGE_MODE;
+    }
+    // a directory changes with every entry added or removed, which is shown below it
+    if(S_ISDIR(new->mode)) {
+        return changes;
+    }
+    if(old->size != new->size) {
+        changes |= CHANGE_SIZE;
+    }
+    if(old->mtime_sec != new->mtime_sec || old->mtime_nsec != new->mtime_nsec) {
+        changes |= CHANGE_MTIME;
+    }
+    if(old->link && new->link && strcmp(old->link, new->link) != 0) {
+        changes |= CHANGE_TARGET;
+    }
+    return changes;
+}
+
+
+/* public function */
+DiffCount diff_records(RecordReader *old, RecordReader *new, bool color) {
+    DiffCount count = {0, 0, 0};
+    Record a, b;
+    diff_color = color;
+    bool has_a = read_record(old, &a), has_b = read_record(new, &b);
+    out_str(".\n");
+    while(has_a || has_b) {
+        int cmp = !has_a ? 1 : !has_b ? -1 : cmp_walk_order(&a, &b);
+        if(cmp < 0) {
+            print_record('-', COLOR_REMOVED, &a, NULL, 0);
+            count.removed++;
+            has_a = read_record(old, &a);
+        } else if(cmp > 0) {
+            print_record('+', COLOR_ADDED, &b, NULL, 0);
+            count.added++;
+            has_b = read_record(new, &b);
+        } else {
+            int changes = record_changes(&a, &b);
+            if(changes) {
+                print_record('~', COLOR_MODIFIED, &b, &a, changes);
+                count.modified++;
+            }
+            has_a = read_record(old, &a);
+            has_b = read_record(new, &b);
+        }
+    }
+    free(shown);
+    shown = NULL;
+    shown_len = shown_capacity = 0;
+    return count;
+}
@@ -0,0 +1,32 @@
+#ifndef _DIFF_H
+#define _DIFF_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "format.h"
+#include "output.h"
+
+#define COLOR_ADDED "\033[1;92m"
+#define COLOR_REMOVED "\033[1;91m"
+#define COLOR_MODIFIED "\033[1;93m"
+
+/* what --diff found, printed as the summary */
+typedef struct DiffCount DiffCount;
+struct DiffCount {
+    long long added, removed, modified;
+};
+
+/*
+    --diff: merge join of two walks, both in walk order with siblings sorted
+    by name. one record of each side is in memory at a time.
+
+    every line starts with a marker, '+' added, '-' removed, '~' modified
+    and ' ' for a directory above a change, then the name indented by depth.
+*/
+DiffCount diff_records(RecordReader *old, RecordReader *new, bool color);
+
+#endif
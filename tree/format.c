@@ -0,0 +1,177 @@
+#include "format.h"
+
+/* private global var */
+// --format=json puts a comma before every record but the first
+bool first_record = true;
+
+
+const char *type_name(mode_t mode) {
+    if(S_ISREG(mode)) {
+        return "file";
+    } else if(S_ISDIR(mode)) {
+        return "directory";
+    } else if(S_ISLNK(mode)) {
+        return "link";
+    } else if(S_ISFIFO(mode)) {
+        return "fifo";
+    } else if(S_ISSOCK(mode)) {
+        return "socket";
+    } else if(S_ISCHR(mode)) {
+        return "char";
+    } else if(S_ISBLK(mode)) {
+        return "block";
+    }
+    return "unknown";
+}
+
+/* quoted json string, bytes that need no escape are written in runs */
+void out_json_str(const char *str, size_t len) {
+    out_char('"');
+    size_t start = 0;
+    for(size_t i = 0; i < len; i++) {
+        unsigned char c = str[i];
+        if(c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out_write(str + start, i - start);
+        start = i + 1;
+        if(c == '"' || c == '\\') {
+            out_char('\\');
+            out_char(c);
+        } else if(c == '\n') {
+            out_str("\\n");
+        } else if(c == '\t') {
+            out_str("\\t");
+        } else {
+            out_printf("\\u%04x", c);
+        }
+    }
+    out_write(str + start, len - start);
+    out_char('"');
+}
+
+void emit_json(Record *rec) {
+    out_str("{\"path\":");
+    out_json_str(rec->path, rec->path_len);
+    out_printf(",\"type\":\"%s\",\"size\":%llu,\"mode\":\"%04o\",\"mtime\":%lld,"
+               "\"mtime_nsec\":%u,\"inode\":%llu",
+               type_name(rec->mode), (unsigned long long)rec->size,
+               (unsigned int)(rec->mode & 07777), (long long)rec->mtime_sec,
+               rec->mtime_nsec, (unsigned long long)rec->ino);
+    if(rec->link) {
+        out_str(",\"target\":");
+        out_json_str(rec->link, strlen(rec->link));
+    }
+    out_char('}');
+}
+
+void emit_binary(Record *rec) {
+    static const char pad[8];
+    size_t link_len = rec->link ? strlen(rec->link) : 0;
+    size_t len = sizeof(BinRecord) + rec->path_len + 1 + link_len + 1;
+    BinRecord bin = {
+        .len = (len + 7) & ~(size_t)7,
+        .mode = rec->mode,
+        .size = rec->size,
+        .ino = rec->ino,
+        .mtime_sec = rec->mtime_sec,
+        .mtime_nsec = rec->mtime_nsec,
+        .path_len = rec->path_len,
+        .link_len = link_len
+    };
+    out_write((char *)&bin, sizeof(bin));
+    out_write(rec->path, rec->path_len);
+    out_char('\0');
+    out_write(rec->link ? rec->link : "", link_len);
+    out_char('\0');
+    out_write(pad, bin.len - len);
+}
+
+
+/* public function */
+void begin_records(int format) {
+    if(format == FORMAT_JSON) {
+        out_str("[\n");
+    } else if(format == FORMAT_BINARY) {
+        BinHeader header = {BIN_MAGIC, BIN_VERSION, sizeof(BinRecord)};
+        out_write((char *)&header, sizeof(header));
+    }
+}
+
+/* one record, written to the output buffer as soon as the entry is reached */
+void emit_record(int format, Record *rec) {
+    if(format == FORMAT_NDJSON) {
+        emit_json(rec);
+        out_char('\n');
+    } else if(format == FORMAT_JSON) {
+        if(!first_record) {
+            out_str(",\n");
+        }
+        first_record = false;
+        emit_json(rec);
+    } else {
+        emit_binary(rec);
+    }
+}
+
+void end_records(int format) {
+    if(format == FORMAT_JSON) {
+        out_str(first_record ? "]\n" : "\n]\n");
+    }
+}
+
+/* check the header, false if file is no --format=binary output */
+bool begin_read_records(RecordReader *reader, FILE *file) {
+    BinHeader header;
+    reader->file = file;
+    reader->buf = NULL;
+    reader->capacity = 0;
+    return fread(&header, sizeof(header), 1, file) == 1 &&
+           memcmp(header.magic, BIN_MAGIC, sizeof(header.magic)) == 0 &&
+           header.version == BIN_VERSION && header.record_size == sizeof(BinRecord);
+}
+
+/* the next record in walk order, false at the end */
+bool read_record(RecordReader *reader, Record *rec) {
+    BinRecord bin;
+    if(fread(&bin, sizeof(bin), 1, reader->file) != 1) {
+        return false;
+    }
+    // a corrupt length must not wrap around, every term is checked in size_t
+    if(bin.len < sizeof(bin)) {
+        fprintf(stderr, "my_tree: corrupt record\n");
+        exit(1);
+    }
+    size_t len = bin.len - sizeof(bin);
+    if(len < (size_t)bin.path_len + bin.link_len + 2) {
+        fprintf(stderr, "my_tree: corrupt record\n");
+        exit(1);
+    }
+    if(len > reader->capacity) {
+        char *new_ptr = realloc(reader->buf, len);
+        if(!new_ptr) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        reader->buf = new_ptr;
+        reader->capacity = len;
+    }
+    if(fread(reader->buf, 1, len, reader->file) != len) {
+        fprintf(stderr, "my_tree: truncated record\n");
+        exit(1);
+    }
+    rec->path = reader->buf;
+    rec->path_len = bin.path_len;
+    rec->link = S_ISLNK(bin.mode) ? reader->buf + bin.path_len + 1 : NULL;
+    rec->mode = bin.mode;
+    rec->size = bin.size;
+    rec->ino = bin.ino;
+    rec->mtime_sec = bin.mtime_sec;
+    rec->mtime_nsec = bin.mtime_nsec;
+    return true;
+}
+
+void end_read_records(RecordReader *reader) {
+    free(reader->buf);
+    fclose(reader->file);
+}
@@ -0,0 +1,81 @@
+#ifndef _FORMAT_H
+#define _FORMAT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "output.h"
+
+/* what print_list writes for every entry */
+enum Format {
+    FORMAT_TREE,
+    FORMAT_NDJSON,
+    FORMAT_JSON,
+    FORMAT_BINARY
+};
+
+/* one entry as seen by the record formats, path is relative to the root */
+typedef struct Record Record;
+struct Record {
+    const char *path;
+    size_t path_len;
+    // symlink target, NULL for other types
+    const char *link;
+    mode_t mode;
+    uint64_t size, ino;
+    int64_t mtime_sec;
+    uint32_t mtime_nsec;
+};
+
+/*
+    --format=binary, host byte order
+
+    BinHeader
+    BinRecord, path, '\0', link target, '\0', zero padding to 8 bytes,
+    repeated for every entry in walk order
+
+    len is the size of the whole record, a reader steps from one record
+    to the next with it and never needs to parse the strings.
+*/
+#define BIN_MAGIC "MYTREEB"
+#define BIN_VERSION 1
+
+typedef struct BinHeader BinHeader;
+struct BinHeader {
+    char magic[8];
+    // record_size = sizeof(BinRecord), strings start right after it
+    uint32_t version, record_size;
+};
+
+typedef struct BinRecord BinRecord;
+struct BinRecord {
+    uint32_t len;
+    // st_mode, type and permission bits
+    uint32_t mode;
+    uint64_t size, ino;
+    int64_t mtime_sec;
+    uint32_t mtime_nsec;
+    // without the '\0', link_len = 0 for everything but symlinks
+    uint32_t path_len, link_len, pad;
+};
+
+/* reads --format=binary back, rec points into buf until the next read */
+typedef struct RecordReader RecordReader;
+struct RecordReader {
+    FILE *file;
+    char *buf;
+    size_t capacity;
+};
+
+void begin_records(int format);
+void emit_record(int format, Record *rec);
+void end_records(int format);
+bool begin_read_records(RecordReader *reader, FILE *file);
+bool read_record(RecordReader *reader, Record *rec);
+void end_read_records(RecordReader *reader);
+
+#endif
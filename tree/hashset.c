@@ -0,0 +1,91 @@
+#include "hashset.h"
+
+#define INIT_HASH_SIZE 1024
+
+/* splitmix64 finalizer, inode numbers are far from random */
+uint64_t hash_dev_ino(uint64_t dev, uint64_t ino) {
+    uint64_t x = ino ^ (dev * 0x9e3779b97f4a7c15ULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+bool is_empty_slot(DevIno *slot) {
+    return slot->dev == 0 && slot->ino == 0;
+}
+
+/* linear probing, the caller knows the key is not there */
+void place_hash_set(HashSet *set, uint64_t dev, uint64_t ino) {
+    size_t mask = set->capacity - 1;
+    size_t i = hash_dev_ino(dev, ino) & mask;
+    while(!is_empty_slot(&set->slot[i])) {
+        i = (i + 1) & mask;
+    }
+    set->slot[i] = (DevIno){dev, ino};
+}
+
+void grow_hash_set(HashSet *set) {
+    DevIno *old = set->slot;
+    size_t old_capacity = set->capacity;
+    set->capacity = old_capacity ? old_capacity * 2 : INIT_HASH_SIZE;
+    set->slot = calloc(set->capacity, sizeof(DevIno));
+    if(!set->slot) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    for(size_t i = 0; i < old_capacity; i++) {
+        if(!is_empty_slot(&old[i])) {
+            place_hash_set(set, old[i].dev, old[i].ino);
+        }
+    }
+    free(old);
+}
+
+/* public function */
+
+/* return true if (dev, ino) was not in the set yet */
+bool insert_hash_set(HashSet *set, uint64_t dev, uint64_t ino) {
+    if((set->size + 1) * 2 > set->capacity) {
+        grow_hash_set(set);
+    }
+    size_t mask = set->capacity - 1;
+    size_t i = hash_dev_ino(dev, ino) & mask;
+    while(!is_empty_slot(&set->slot[i])) {
+        if(set->slot[i].dev == dev && set->slot[i].ino == ino) {
+            return false;
+        }
+        i = (i + 1) & mask;
+    }
+    set->slot[i] = (DevIno){dev, ino};
+    set->size++;
+    return true;
+}
+
+void free_hash_set(HashSet *set) {
+    free(set->slot);
+    set->slot = NULL;
+    set->capacity = set->size = 0;
+}
+
+void init_sharded_hash_set(ShardedHashSet *set) {
+    for(int i = 0; i < HASH_SHARDS; i++) {
+        pthread_mutex_init(&set->shard[i].lock, NULL);
+        set->shard[i].set = (HashSet){0, 0, NULL};
+    }
+}
+
+/* same as insert_hash_set, the top bits of the hash pick the shard */
+bool insert_sharded_hash_set(ShardedHashSet *set, uint64_t dev, uint64_t ino) {
+    HashShard *shard = &set->shard[hash_dev_ino(dev, ino) >> 58 & (HASH_SHARDS - 1)];
+    pthread_mutex_lock(&shard->lock);
+    bool result = insert_hash_set(&shard->set, dev, ino);
+    pthread_mutex_unlock(&shard->lock);
+    return result;
+}
+
+void free_sharded_hash_set(ShardedHashSet *set) {
+    for(int i = 0; i < HASH_SHARDS; i++) {
+        free_hash_set(&set->shard[i].set);
+        pthread_mutex_destroy(&set->shard[i].lock);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef _HASHSET_H
+#define _HASHSET_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/* open addressing set of (dev, ino), (0, 0) marks an empty slot */
+typedef struct DevIno DevIno;
+struct DevIno {
+    uint64_t dev, ino;
+};
+
+typedef struct HashSet HashSet;
+struct HashSet {
+    // capacity is a power of two, kept at most half full
+    size_t capacity, size;
+    DevIno *slot;
+};
+
+#define HASH_SHARDS 64
+
+/* HashSet split by hash into shards with a lock each, for inserts from any thread */
+typedef struct HashShard HashShard;
+struct HashShard {
+    pthread_mutex_t lock;
+    HashSet set;
+};
+
+typedef struct ShardedHashSet ShardedHashSet;
+struct ShardedHashSet {
+    HashShard shard[HASH_SHARDS];
+};
+
+bool insert_hash_set(HashSet *set, uint64_t dev, uint64_t ino);
+void free_hash_set(HashSet *set);
+void init_sharded_hash_set(ShardedHashSet *set);
+bool insert_sharded_hash_set(ShardedHashSet *set, uint64_t dev, uint64_t ino);
+void free_sharded_hash_set(ShardedHashSet *set);
+
+#endif
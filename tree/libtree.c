@@ -0,0 +1,1642 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <pthread.h>
+
+#include "libtree.h"
+#include "backend.h"
+#include "cache.h"
+#include "hashset.h"
+#include "sort.h"
+#include "match.h"
+#include "stats.h"
+#include "spill.h"
+
+#define INIT_DEPTH 2
+#define DIRENT_BUF_SIZE 32768
+#define INIT_ARENA_SIZE 4096
+#define INOTIFY_BUF_SIZE 65536
+// -j workers stop scanning ahead once this many scanned listings are alive
+#define MAX_SCANNED_LISTS 1024
+// wait this long for more events before redrawing
+#define WATCH_DEBOUNCE_MS 100
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                    IN_MODIFY | IN_ATTRIB | IN_ONLYDIR)
+
+/* raw record returned by getdents64 */
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* bump arena, every string of a listing is packed in one buffer */
+typedef struct Arena Arena;
+struct Arena {
+    char *buf;
+    size_t used, capacity;
+};
+
+/* copy len bytes of str plus '\0' and return the offset, it survives growing */
+uint32_t arena_push(Arena *arena, const char *str, size_t len) {
+    if(arena->used + len + 1 > arena->capacity) {
+        size_t capacity = arena->capacity ? arena->capacity : INIT_ARENA_SIZE;
+        while(arena->used + len + 1 > capacity) {
+            capacity <<= 1;
+        }
+        char *new_ptr = realloc(arena->buf, capacity);
+        if(new_ptr == NULL) {
+            printf("realloc error\n");
+            exit(1);
+        }
+        arena->buf = new_ptr;
+        arena->capacity = capacity;
+    }
+    uint32_t off = arena->used;
+    memcpy(arena->buf + off, str, len);
+    arena->buf[off + len] = '\0';
+    arena->used += len + 1;
+    return off;
+}
+
+/* replace the content of arena with len bytes of buf */
+void arena_load(Arena *arena, const char *buf, size_t len) {
+    if(len > arena->capacity) {
+        char *new_ptr = realloc(arena->buf, len);
+        if(new_ptr == NULL) {
+            printf("realloc error\n");
+            exit(1);
+        }
+        arena->buf = new_ptr;
+        arena->capacity = len;
+    }
+    if(len) {
+        memcpy(arena->buf, buf, len);
+    }
+    arena->used = len;
+}
+
+/* path list */
+enum ListState {
+    LIST_QUEUED,
+    LIST_SCANNING,
+    LIST_READY
+};
+
+/* what --prune found out about a listing */
+enum ListContent {
+    CONTENT_UNKNOWN,
+    CONTENT_EMPTY,
+    CONTENT_FOUND
+};
+
+#define NO_LINK UINT32_MAX
+// Entry flags, -l only
+#define ENT_DIR_LINK 1
+#define ENT_VISITED 2
+#define ENT_CYCLE 4
+
+typedef struct Entry Entry;
+struct Entry {
+    // offset of the name in the list arena
+    uint32_t name, name_len;
+    // offset of the symlink target, NO_LINK for other types
+    uint32_t link;
+    // type from d_type, completed with the permission bits by statx
+    mode_t mode;
+    uint32_t nlink;
+    off_t size;
+    // only asked for by --du, dev and ino are the target's for a directory link
+    uint64_t blocks, dev, ino;
+    // only asked for by --format
+    int64_t mtime_sec;
+    uint32_t mtime_nsec;
+    // ENT_DIR_LINK from statx, the others once the walk thread gets to the entry
+    uint32_t flags;
+};
+
+typedef struct PathList PathList;
+typedef struct Worker Worker;
+
+struct TreeWalk {
+    TreeOptions opt;
+    Matcher include, exclude;
+    // opt.stat_mask plus what the walk itself needs
+    unsigned int stat_mask;
+    // what init_backend settled on
+    int backend;
+    char *cache_path;
+    // open for the length of one run
+    Cache *cache;
+    const TreeVisitor *visitor;
+    // path of the entry being visited, "a/b/c" relative to the root
+    Arena cur_path;
+
+    // one reusable listing per depth when walking in one thread
+    int depth_list_size;
+    PathList **depth_list;
+    // device of the root, for one_file_system
+    uint64_t root_dev;
+    // every directory listed so far, for follow_links
+    ShardedHashSet visited;
+
+    // -j pool, idle workers sleep on work_cond until something is queued or shutdown
+    Worker *workers;
+    pthread_mutex_t pool_lock;
+    pthread_cond_t work_cond;
+    int queued;
+    // scanned listings not freed yet, workers also sleep while it is at MAX_SCANNED_LISTS
+    int scanned;
+    bool shutdown_pool;
+    // the walk thread sleeps on ready_cond until the list it needs is scanned
+    pthread_mutex_t ready_lock;
+    pthread_cond_t ready_cond;
+
+    // watch_tree_walk keeps the whole tree and an inotify watch per directory
+    bool watching;
+    int inotify_fd;
+    // wd -> listing
+    PathList **wd_list;
+    int wd_list_size;
+};
+
+struct PathList {
+    TreeWalk *walk;
+    // capacity = entry memory size
+    // top = the number of entry
+    int capacity, top;
+    Entry *ent;
+    Arena names;
+    // the listed directory is name inside parent, parent is NULL for the root
+    PathList *parent;
+    const char *name;
+    // 0 for the root, the entries of the list are one level deeper
+    int depth;
+    // fd of the listed directory, closed once every sub directory is opened
+    int fd, unopened;
+    // listing of every sub directory, only used by -j, --watch and --prune
+    PathList **sub;
+    int content;
+    // sorted runs of a listing too big for opt.mem_limit, ent holds the merge window
+    Spill *spill;
+    // inotify watch of the listed directory, --watch mode only
+    int wd;
+    bool dirty;
+    // --watch, the whole sub tree, adjusted by every event
+    TreeCount count;
+    int state;
+    // scanned by expand_path_list and counted in walk->scanned until the walk thread is done
+    bool pooled;
+    // the walk thread and the deque holding the list both own a reference
+    int refs;
+};
+
+/* parent = NULL for the root, the caller sets walk then */
+PathList *new_path_list(PathList *parent, const char *name) {
+    PathList *result = calloc(1, sizeof(PathList));
+    if(!result) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    result->walk = parent ? parent->walk : NULL;
+    // init size is 16
+    result->capacity = 16;
+    result->ent = calloc(1, sizeof(Entry) * 16);
+    result->parent = parent;
+    result->name = name;
+    result->depth = parent ? parent->depth + 1 : 0;
+    result->fd = -1;
+    result->wd = -1;
+    result->state = LIST_QUEUED;
+    result->refs = 1;
+    return result;
+}
+
+/* drop the deque's reference, the last one frees the listing */
+void put_path_list(PathList *list) {
+    if(__atomic_sub_fetch(&list->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    free(list->ent);
+    free(list->names.buf);
+    free(list->sub);
+    if(list->spill) {
+        free_spill(list->spill);
+    }
+    free(list);
+}
+
+/*
+    the walk thread is done with list. the entries of a -j listing go now,
+    a deque may hold the empty shell until a worker pops it.
+*/
+void free_path_list(PathList *list) {
+    if(list->pooled) {
+        TreeWalk *walk = list->walk;
+        list->pooled = false;
+        free(list->ent);
+        free(list->names.buf);
+        free(list->sub);
+        list->ent = NULL;
+        list->names.buf = NULL;
+        list->sub = NULL;
+        // wake the workers once they may scan ahead again
+        if(__atomic_sub_fetch(&walk->scanned, 1, __ATOMIC_RELAXED) == MAX_SCANNED_LISTS - 1) {
+            pthread_mutex_lock(&walk->pool_lock);
+            pthread_cond_broadcast(&walk->work_cond);
+            pthread_mutex_unlock(&walk->pool_lock);
+        }
+    }
+    put_path_list(list);
+}
+
+/* drop every entry but keep the memory for the next directory */
+void reset_path_list(PathList *list, PathList *parent, const char *name) {
+    list->top = 0;
+    list->names.used = 0;
+    list->parent = parent;
+    list->name = name;
+    list->depth = parent ? parent->depth + 1 : 0;
+    list->fd = -1;
+    list->unopened = 0;
+    list->content = CONTENT_UNKNOWN;
+    if(list->spill) {
+        free_spill(list->spill);
+        list->spill = NULL;
+    }
+}
+
+/* listing for a directory at depth, reused once visit_list returns from it */
+PathList *depth_path_list(TreeWalk *walk, int depth, PathList *parent, const char *name) {
+    if(depth >= walk->depth_list_size) {
+        int new_size = walk->depth_list_size ? walk->depth_list_size * 2 : INIT_DEPTH;
+        while(depth >= new_size) {
+            new_size *= 2;
+        }
+        PathList **new_ptr = realloc(walk->depth_list, sizeof(PathList*) * new_size);
+        if(!new_ptr) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        memset(new_ptr + walk->depth_list_size, 0, sizeof(PathList*) * (new_size - walk->depth_list_size));
+        walk->depth_list = new_ptr;
+        walk->depth_list_size = new_size;
+    }
+    if(!walk->depth_list[depth]) {
+        walk->depth_list[depth] = new_path_list(parent, name);
+    } else {
+        reset_path_list(walk->depth_list[depth], parent, name);
+    }
+    walk->depth_list[depth]->walk = walk;
+    return walk->depth_list[depth];
+}
+
+char *entry_name(PathList *list, Entry *ent) {
+    return list->names.buf + ent->name;
+}
+
+char *entry_link(PathList *list, Entry *ent) {
+    return list->names.buf + ent->link;
+}
+
+/*
+    whether the entry is a directory whose listing may be visited, max_depth
+    stops it and so does a mount point with one_file_system. follow_links
+    may still find a link is a cycle.
+*/
+bool descend(PathList *list, Entry *ent) {
+    TreeWalk *walk = list->walk;
+    return (S_ISDIR(ent->mode) || ent->flags & ENT_DIR_LINK) && list->depth + 1 < walk->opt.max_depth &&
+           (!walk->opt.one_file_system || ent->dev == walk->root_dev);
+}
+
+void append_path_list(PathList *cur_list, const char *path, size_t path_len, unsigned char d_type) {
+    // realloc
+    if(cur_list->capacity < cur_list->top + 1) {
+        cur_list->capacity <<= 1;
+        Entry *new_ptr = realloc(cur_list->ent, sizeof(Entry) * cur_list->capacity);
+        if(new_ptr == NULL) {
+            printf("realloc error\n");
+            exit(1);
+        };
+        cur_list->ent = new_ptr;
+    }
+    Entry *ent = &cur_list->ent[cur_list->top++];
+    // the whole entry, padding included, may end up in the cache
+    memset(ent, 0, sizeof(Entry));
+    ent->name = arena_push(&cur_list->names, path, path_len);
+    ent->name_len = path_len;
+    ent->link = NO_LINK;
+    // DT_UNKNOWN maps to 0 and is filled in by statx
+    ent->mode = DTTOIF(d_type);
+}
+
+// per thread scratch for sort_path_list, swapped with the sorted listing
+__thread Entry *sort_ent = NULL;
+__thread int sort_ent_capacity = 0;
+__thread uint32_t *sort_key = NULL;
+__thread int sort_key_capacity = 0;
+__thread Arena sort_xfrm;
+
+/* a thread done with walking lets go of its scratch space */
+void free_thread_scratch() {
+    free(sort_ent);
+    free(sort_key);
+    free(sort_xfrm.buf);
+    sort_ent = NULL;
+    sort_key = NULL;
+    sort_xfrm = (Arena){0};
+    sort_ent_capacity = sort_key_capacity = 0;
+    free_sort_scratch();
+}
+
+/* collation key of name, computed once instead of on every comparison */
+uint32_t push_xfrm(Arena *arena, char *name) {
+    char buf[1024];
+    size_t len = strxfrm(buf, name, sizeof(buf));
+    if(len < sizeof(buf)) {
+        return arena_push(arena, buf, len);
+    }
+    char *big = malloc(len + 1);
+    strxfrm(big, name, len + 1);
+    uint32_t off = arena_push(arena, big, len);
+    free(big);
+    return off;
+}
+
+/* order the entries of list by name or collation key with a radix sort */
+void sort_path_list(PathList *list) {
+    TreeWalk *walk = list->walk;
+    if(walk->opt.sort == SORT_NONE || list->top < 2) {
+        return;
+    }
+    int n = list->top;
+    if(n * 2 > sort_key_capacity) {
+        sort_key_capacity = n * 2;
+        free(sort_key);
+        sort_key = malloc(sizeof(uint32_t) * sort_key_capacity);
+    }
+    if(list->capacity > sort_ent_capacity) {
+        sort_ent_capacity = list->capacity;
+        free(sort_ent);
+        sort_ent = malloc(sizeof(Entry) * sort_ent_capacity);
+    }
+    if(!sort_key || !sort_ent) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    uint32_t *key_off = sort_key, *order = sort_key + n;
+    const char *keys = list->names.buf;
+    if(walk->opt.sort == SORT_LOCALE) {
+        sort_xfrm.used = 0;
+        for(int i = 0; i < n; i++) {
+            key_off[i] = push_xfrm(&sort_xfrm, entry_name(list, &list->ent[i]));
+        }
+        keys = sort_xfrm.buf;
+    } else {
+        for(int i = 0; i < n; i++) {
+            key_off[i] = list->ent[i].name;
+        }
+    }
+    radix_sort_keys(keys, key_off, n, order);
+
+    for(int i = 0; i < n; i++) {
+        sort_ent[i] = list->ent[order[i]];
+    }
+    // the old array becomes the scratch of the next call
+    Entry *old = list->ent;
+    int old_capacity = list->capacity;
+    list->ent = sort_ent;
+    list->capacity = sort_ent_capacity;
+    sort_ent = old;
+    sort_ent_capacity = old_capacity;
+}
+
+/* one counted sub directory of list is done with its fd, the last one closes it */
+void release_path_list(PathList *list) {
+    if(__atomic_sub_fetch(&list->unopened, 1, __ATOMIC_ACQ_REL) == 0) {
+        close(list->fd);
+        count_call(CALL_CLOSE, 1);
+    }
+}
+
+/* open the directory relative to its parent, no path is ever resolved twice */
+void open_path_list(PathList *list) {
+    TreeWalk *walk = list->walk;
+    PathList *parent = list->parent;
+    uint64_t start = phase_start();
+    // the root may well be a link, it was asked for by name
+    bool nofollow = parent && !walk->opt.follow_links;
+    list->fd = openat(parent ? parent->fd : AT_FDCWD, list->name,
+                      O_RDONLY | O_DIRECTORY | (nofollow ? O_NOFOLLOW : 0) | O_CLOEXEC);
+    count_call(CALL_OPENAT, 1);
+    if(parent) {
+        release_path_list(parent);
+    }
+    phase_end(PHASE_OPEN, start);
+}
+
+/* drop the files -P does not match, for the entries d_type left untyped */
+void include_path_list(PathList *list) {
+    TreeWalk *walk = list->walk;
+    int top = 0;
+    for(int i = 0; i < list->top; i++) {
+        Entry *ent = &list->ent[i];
+        if(S_ISDIR(ent->mode) || match_name(&walk->include, entry_name(list, ent), ent->name_len)) {
+            list->ent[top++] = *ent;
+        }
+    }
+    list->top = top;
+}
+
+void stat_entries(PathList *list, bool untyped);
+
+/*
+    --mem-limit: sort and stat what was read so far and write it out as one
+    run. every sub directory is counted here, they are opened later from
+    the merged listing.
+*/
+void spill_path_list(PathList *list, bool untyped) {
+    TreeWalk *walk = list->walk;
+    sort_path_list(list);
+    stat_entries(list, untyped);
+    if(!list->spill) {
+        list->spill = new_spill(sizeof(Entry), walk->opt.sort, walk->opt.mem_limit);
+    }
+    begin_run(list->spill);
+    for(int i = 0; i < list->top; i++) {
+        Entry *ent = &list->ent[i];
+        bool link = ent->link != NO_LINK;
+        spill_record(list->spill, ent, entry_name(list, ent), ent->name_len,
+                     link ? entry_link(list, ent) : NULL,
+                     link ? strlen(entry_link(list, ent)) : 0);
+        if(descend(list, ent)) {
+            list->unopened++;
+        }
+    }
+    list->top = 0;
+    list->names.used = 0;
+}
+
+/* bytes held by the listing, sorting it takes about as much again */
+size_t list_memory(PathList *list) {
+    return (size_t)list->top * sizeof(Entry) + list->names.used;
+}
+
+/* read and sort the names, return whether d_type left some type unknown */
+bool sort(PathList *result) {
+    TreeWalk *walk = result->walk;
+    // get all file name straight from getdents64, no DIR stream in between
+    char buf[DIRENT_BUF_SIZE];
+    long n;
+    bool untyped = false;
+    uint64_t start = phase_start();
+    while(true) {
+        n = syscall(SYS_getdents64, result->fd, buf, sizeof(buf));
+        count_call(CALL_GETDENTS64, 1);
+        if(n <= 0) {
+            break;
+        }
+        for(long off = 0; off < n;) {
+            struct linux_dirent64 *cur_dir = (struct linux_dirent64 *)(buf + off);
+            off += cur_dir->d_reclen;
+            char *name = cur_dir->d_name;
+            // skip . and .. and hidden file
+            if(name[0] == '.' && (walk->opt.skip_hidden || name[1] == '\0' ||
+                                  (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            size_t len = strlen(name);
+            unsigned char d_type = cur_dir->d_type;
+            // patterns only see the name, excluded entries are never stat'ed
+            if(walk->exclude.n && match_name(&walk->exclude, name, len)) {
+                continue;
+            }
+            if(walk->include.n && d_type != DT_DIR && d_type != DT_UNKNOWN &&
+               !match_name(&walk->include, name, len)) {
+                continue;
+            }
+            untyped |= d_type == DT_UNKNOWN;
+            append_path_list(result, name, len, d_type);
+        }
+        if(walk->opt.mem_limit && list_memory(result) > walk->opt.mem_limit / 2) {
+            phase_end(PHASE_READDIR, start);
+            spill_path_list(result, untyped);
+            untyped = false;
+            start = phase_start();
+        }
+    }
+    phase_end(PHASE_READDIR, start);
+    if(result->spill) {
+        // the rest becomes the last run, visit_list merges them
+        if(result->top) {
+            spill_path_list(result, untyped);
+        }
+        start_merge(result->spill);
+        return false;
+    }
+    start = phase_start();
+    sort_path_list(result);
+    phase_end(PHASE_SORT, start);
+    return untyped;
+}
+
+void read_link(PathList *list, Entry *ent) {
+    char stack_buf[PATH_MAX];
+    char *buf = stack_buf;
+    size_t size = sizeof(stack_buf);
+    uint64_t start = phase_start();
+    ssize_t len;
+    // a full buffer may have cut the target short, st_size is not reliable
+    while((len = readlinkat(list->fd, entry_name(list, ent), buf, size)) == (ssize_t)size) {
+        count_call(CALL_READLINKAT, 1);
+        size *= 2;
+        char *new_ptr = realloc(buf == stack_buf ? NULL : buf, size);
+        if(!new_ptr) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        buf = new_ptr;
+    }
+    count_call(CALL_READLINKAT, 1);
+    phase_end(PHASE_READLINK, start);
+    ent->link = arena_push(&list->names, buf, len < 0 ? 0 : len);
+    if(buf != stack_buf) {
+        free(buf);
+    }
+}
+
+/* -l: whether the link leads to a directory, which one is kept in dev and ino */
+void follow_link(PathList *list, Entry *ent) {
+    struct statx stx;
+    uint64_t start = phase_start();
+    int res = statx(list->fd, entry_name(list, ent), AT_NO_AUTOMOUNT, STATX_TYPE | STATX_INO, &stx);
+    count_call(CALL_STATX, 1);
+    phase_end(PHASE_STAT, start);
+    if(res == 0 && S_ISDIR(stx.stx_mode)) {
+        ent->flags |= ENT_DIR_LINK;
+        ent->dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        ent->ino = stx.stx_ino;
+    }
+}
+
+const char *batch_name(void *arg, int idx) {
+    PathList *list = arg;
+    return entry_name(list, &list->ent[idx]);
+}
+
+void batch_done(void *arg, int idx, int res, struct statx *stx) {
+    Entry *ent = &((PathList *)arg)->ent[idx];
+    if(res == 0) {
+        ent->mode = stx->stx_mode;
+        ent->size = stx->stx_size;
+        ent->nlink = stx->stx_nlink;
+        ent->blocks = stx->stx_blocks;
+        ent->dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+        ent->ino = stx->stx_ino;
+        ent->mtime_sec = stx->stx_mtime.tv_sec;
+        ent->mtime_nsec = stx->stx_mtime.tv_nsec;
+    }
+}
+
+/* stat every entry read so far and read the symlink targets */
+void stat_entries(PathList *list, bool untyped) {
+    TreeWalk *walk = list->walk;
+    /*
+        one statx per entry, asking only for what the visitor uses.
+        the type is already known from d_type, but the size summary and
+        the executable colour still need the size and permission bits.
+        the whole listing is handed to the backend at once, names must not
+        move until it returns, so symlinks are read afterwards.
+    */
+    StatBatch batch = {
+        .dir_fd = list->fd,
+        .flags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+        .mask = walk->stat_mask,
+        .n = list->top,
+        .name = batch_name,
+        .done = batch_done,
+        .arg = list
+    };
+    uint64_t start = phase_start();
+    run_stat_batch(walk->backend, &batch);
+    phase_end(PHASE_STAT, start);
+    if(untyped && walk->include.n) {
+        include_path_list(list);
+    }
+
+    for(int i = 0; i < list->top; i++) {
+        if(S_ISLNK(list->ent[i].mode)) {
+            read_link(list, &list->ent[i]);
+            if(walk->opt.follow_links) {
+                follow_link(list, &list->ent[i]);
+            }
+        }
+    }
+}
+
+/* read the listing from disk and stat every entry */
+void stat_path_list(PathList *list) {
+    bool untyped = sort(list);
+    // a spilled listing was stat'ed run by run
+    if(!list->spill) {
+        stat_entries(list, untyped);
+    }
+}
+
+/* identify the directory for the cache, one statx on the open fd */
+bool cache_key(PathList *list, CacheDir *key) {
+    struct statx stx;
+    count_call(CALL_STATX, 1);
+    if(statx(list->fd, "", AT_EMPTY_PATH, STATX_INO | STATX_MTIME, &stx) != 0) {
+        return false;
+    }
+    key->dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    key->ino = stx.stx_ino;
+    key->mtime_sec = stx.stx_mtime.tv_sec;
+    key->mtime_nsec = stx.stx_mtime.tv_nsec;
+    return true;
+}
+
+/* reuse the listing of the last run if the directory mtime did not change */
+bool load_cached_list(PathList *list, CacheDir *key) {
+    TreeWalk *walk = list->walk;
+    CacheDir *dir = lookup_cache(walk->cache, key);
+    // a listing over --mem-limit gets read and spilled again
+    if(!dir || (walk->opt.mem_limit && (size_t)dir->n * sizeof(Entry) + dir->names_len > walk->opt.mem_limit / 2)) {
+        return false;
+    }
+    if(list->capacity < (int)dir->n) {
+        Entry *new_ptr = realloc(list->ent, sizeof(Entry) * dir->n);
+        if(new_ptr == NULL) {
+            printf("realloc error\n");
+            exit(1);
+        }
+        list->ent = new_ptr;
+        list->capacity = dir->n;
+    }
+    memcpy(list->ent, cache_entries(dir), sizeof(Entry) * dir->n);
+    list->top = dir->n;
+    arena_load(&list->names, cache_names(dir, sizeof(Entry)), dir->names_len);
+    return true;
+}
+
+void watch_path_list(PathList *list);
+
+/* "./a/b" for --stats, cut off at the end if it does not fit */
+void list_path(PathList *list, char *buf, size_t size) {
+    PathList *chain[list->depth + 1];
+    int top = 0;
+    for(PathList *cur = list; cur; cur = cur->parent) {
+        chain[top++] = cur;
+    }
+    size_t len = 0;
+    buf[0] = '\0';
+    while(top-- && len + 1 < size) {
+        len += snprintf(buf + len, size - len, "%s%s", len ? "/" : "", chain[top]->name);
+    }
+}
+
+/* list every name of dir in order and stat all of them relative to the dir fd */
+void scan_path_list(PathList *list) {
+    TreeWalk *walk = list->walk;
+    uint64_t scan_start = phase_start();
+    open_path_list(list);
+    if(list->fd < 0) {
+        return;
+    }
+    if(walk->watching) {
+        watch_path_list(list);
+    }
+    CacheDir key;
+    uint64_t start = phase_start();
+    bool keyed = walk->cache && cache_key(list, &key);
+    bool cached = keyed && load_cached_list(list, &key);
+    phase_end(PHASE_CACHE, start);
+    if(!cached) {
+        stat_path_list(list);
+    }
+    if(keyed && !list->spill) {
+        start = phase_start();
+        key.n = list->top;
+        key.names_len = list->names.used;
+        store_cache(walk->cache, &key, list->ent, list->names.buf);
+        phase_end(PHASE_CACHE, start);
+    }
+
+    // a spilled listing counted them run by run
+    int sub_dir = list->spill ? list->unopened : 0;
+    for(int i = 0; !list->spill && i < list->top; i++) {
+        if(descend(list, &list->ent[i])) {
+            sub_dir++;
+        }
+    }
+    list->unopened = sub_dir;
+    if(!sub_dir) {
+        close(list->fd);
+        count_call(CALL_CLOSE, 1);
+    }
+    uint64_t ns = count_dir(list->spill ? list->spill->count : (uint64_t)list->top,
+                            list->depth, scan_start);
+    if(ns) {
+        char path[PATH_MAX];
+        list_path(list, path, sizeof(path));
+        add_slow_dir(path, ns);
+    }
+}
+
+/*
+    work stealing pool for -j mode
+    every worker owns a deque: the owner pushes and pops at the bottom so
+    it walks depth first like the walk thread does, thieves steal the oldest
+    (shallowest) directory from the top.
+*/
+typedef struct Deque Deque;
+struct Deque {
+    pthread_mutex_t lock;
+    int head, tail, capacity;
+    PathList **buf;
+};
+
+struct Worker {
+    pthread_t tid;
+    int id;
+    TreeWalk *walk;
+    Deque deque;
+};
+
+void push_deque(TreeWalk *walk, Deque *deque, PathList *list) {
+    pthread_mutex_lock(&deque->lock);
+    if(deque->tail - deque->head == deque->capacity) {
+        // grow and move the live part to the front
+        int size = deque->tail - deque->head;
+        PathList **new_buf = calloc(deque->capacity * 2, sizeof(PathList*));
+        if(!new_buf) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        for(int i = 0; i < size; i++) {
+            new_buf[i] = deque->buf[(deque->head + i) % deque->capacity];
+        }
+        free(deque->buf);
+        deque->buf = new_buf;
+        deque->capacity *= 2;
+        deque->head = 0;
+        deque->tail = size;
+    }
+    deque->buf[deque->tail++ % deque->capacity] = list;
+    pthread_mutex_unlock(&deque->lock);
+
+    pthread_mutex_lock(&walk->pool_lock);
+    __atomic_add_fetch(&walk->queued, 1, __ATOMIC_RELAXED);
+    pthread_cond_signal(&walk->work_cond);
+    pthread_mutex_unlock(&walk->pool_lock);
+}
+
+PathList *pop_deque(TreeWalk *walk, Deque *deque, bool steal) {
+    PathList *result = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if(deque->head < deque->tail) {
+        if(steal) {
+            result = deque->buf[deque->head++ % deque->capacity];
+        } else {
+            result = deque->buf[--deque->tail % deque->capacity];
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+    if(result) {
+        __atomic_sub_fetch(&walk->queued, 1, __ATOMIC_RELAXED);
+    }
+    return result;
+}
+
+PathList *take_work(Worker *self) {
+    TreeWalk *walk = self->walk;
+    PathList *result = pop_deque(walk, &self->deque, false);
+    for(int i = 1; !result && i < walk->opt.jobs; i++) {
+        result = pop_deque(walk, &walk->workers[(self->id + i) % walk->opt.jobs].deque, true);
+    }
+    return result;
+}
+
+/* claim list, the walk thread may have scanned it already */
+bool claim_path_list(PathList *list) {
+    int expected = LIST_QUEUED;
+    return __atomic_compare_exchange_n(&list->state, &expected, LIST_SCANNING,
+                                       false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void finish_path_list(PathList *list) {
+    TreeWalk *walk = list->walk;
+    pthread_mutex_lock(&walk->ready_lock);
+    __atomic_store_n(&list->state, LIST_READY, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&walk->ready_cond);
+    pthread_mutex_unlock(&walk->ready_lock);
+}
+
+/* scan list and hand its sub directories to the pool */
+void expand_path_list(PathList *list, Worker *self) {
+    list->pooled = true;
+    __atomic_add_fetch(&list->walk->scanned, 1, __ATOMIC_RELAXED);
+    scan_path_list(list);
+    list->sub = calloc(list->top + 1, sizeof(PathList*));
+    for(int i = 0; i < list->top; i++) {
+        // a directory link waits for the walk thread to rule out a cycle
+        if(descend(list, &list->ent[i]) && S_ISDIR(list->ent[i].mode)) {
+            list->sub[i] = new_path_list(list, entry_name(list, &list->ent[i]));
+            list->sub[i]->refs = 2;
+        }
+    }
+    // push in reverse, so the owner pops the first sub directory first
+    for(int i = list->top - 1; i >= 0; i--) {
+        if(list->sub[i]) {
+            push_deque(list->walk, &self->deque, list->sub[i]);
+        }
+    }
+    finish_path_list(list);
+}
+
+void *worker_main(void *arg) {
+    Worker *self = arg;
+    TreeWalk *walk = self->walk;
+    while(true) {
+        // too far ahead of the walk thread, the rest stays queued until it frees some listings
+        bool ahead = __atomic_load_n(&walk->scanned, __ATOMIC_RELAXED) >= MAX_SCANNED_LISTS;
+        PathList *list = ahead ? NULL : take_work(self);
+        if(!list) {
+            pthread_mutex_lock(&walk->pool_lock);
+            while((!__atomic_load_n(&walk->queued, __ATOMIC_RELAXED) ||
+                   __atomic_load_n(&walk->scanned, __ATOMIC_RELAXED) >= MAX_SCANNED_LISTS) &&
+                  !walk->shutdown_pool) {
+                pthread_cond_wait(&walk->work_cond, &walk->pool_lock);
+            }
+            bool stop = walk->shutdown_pool;
+            pthread_mutex_unlock(&walk->pool_lock);
+            if(stop) {
+                free_thread_scratch();
+                return NULL;
+            }
+            continue;
+        }
+        if(claim_path_list(list)) {
+            expand_path_list(list, self);
+        }
+        put_path_list(list);
+    }
+}
+
+void start_pool(TreeWalk *walk) {
+    // every scanned directory keeps its fd until its sub directories are opened
+    struct rlimit lim;
+    if(getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    walk->workers = calloc(walk->opt.jobs, sizeof(Worker));
+    if(!walk->workers) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    walk->queued = 0;
+    walk->scanned = 0;
+    walk->shutdown_pool = false;
+    for(int i = 0; i < walk->opt.jobs; i++) {
+        walk->workers[i].id = i;
+        walk->workers[i].walk = walk;
+        walk->workers[i].deque.capacity = 64;
+        walk->workers[i].deque.buf = calloc(64, sizeof(PathList*));
+        pthread_mutex_init(&walk->workers[i].deque.lock, NULL);
+    }
+    for(int i = 0; i < walk->opt.jobs; i++) {
+        if(pthread_create(&walk->workers[i].tid, NULL, worker_main, &walk->workers[i]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+}
+
+void stop_pool(TreeWalk *walk) {
+    pthread_mutex_lock(&walk->pool_lock);
+    walk->shutdown_pool = true;
+    pthread_cond_broadcast(&walk->work_cond);
+    pthread_mutex_unlock(&walk->pool_lock);
+    for(int i = 0; i < walk->opt.jobs; i++) {
+        pthread_join(walk->workers[i].tid, NULL);
+    }
+    for(int i = 0; i < walk->opt.jobs; i++) {
+        PathList *list;
+        while((list = pop_deque(walk, &walk->workers[i].deque, true))) {
+            // the walk thread scanned it itself, only the deque still holds it
+            put_path_list(list);
+        }
+        free(walk->workers[i].deque.buf);
+        pthread_mutex_destroy(&walk->workers[i].deque.lock);
+    }
+    free(walk->workers);
+    walk->workers = NULL;
+}
+
+/* block until list is scanned, scanning it here if no worker took it yet */
+void wait_path_list(PathList *list) {
+    TreeWalk *walk = list->walk;
+    if(claim_path_list(list)) {
+        // no worker has it, the walk thread is about to need it anyway
+        expand_path_list(list, &walk->workers[0]);
+        return;
+    }
+    pthread_mutex_lock(&walk->ready_lock);
+    while(__atomic_load_n(&list->state, __ATOMIC_ACQUIRE) != LIST_READY) {
+        pthread_cond_wait(&walk->ready_cond, &walk->ready_lock);
+    }
+    pthread_mutex_unlock(&walk->ready_lock);
+}
+
+/* append name to cur_path and return what pop_path needs to take it off again */
+uint32_t push_path(TreeWalk *walk, const char *name, size_t len) {
+    uint32_t old = walk->cur_path.used;
+    if(old) {
+        walk->cur_path.buf[old - 1] = '/';
+    }
+    arena_push(&walk->cur_path, name, len);
+    return old;
+}
+
+void pop_path(TreeWalk *walk, uint32_t old) {
+    walk->cur_path.used = old;
+    if(old) {
+        walk->cur_path.buf[old - 1] = '\0';
+    }
+}
+
+/* listing of the i-th entry of list, scanned and ready to be visited */
+PathList *sub_path_list(PathList *list, int i) {
+    TreeWalk *walk = list->walk;
+    if(walk->watching) {
+        return list->sub[i];
+    } else if(walk->opt.jobs > 1) {
+        if(!list->sub[i]) {
+            // a followed link, nobody queued it
+            list->sub[i] = new_path_list(list, entry_name(list, &list->ent[i]));
+        }
+        wait_path_list(list->sub[i]);
+        return list->sub[i];
+    } else if(walk->opt.prune) {
+        // kept until visited, the emptiness check may have looked ahead
+        if(!list->sub) {
+            list->sub = calloc(list->top + 1, sizeof(PathList*));
+            if(!list->sub) {
+                perror("Memory leak!");
+                exit(1);
+            }
+        }
+        if(!list->sub[i]) {
+            list->sub[i] = new_path_list(list, entry_name(list, &list->ent[i]));
+            scan_path_list(list->sub[i]);
+        }
+        return list->sub[i];
+    }
+    PathList *sub_list = depth_path_list(walk, list->depth + 1, list, entry_name(list, &list->ent[i]));
+    scan_path_list(sub_list);
+    return sub_list;
+}
+
+/*
+    whether the listing of the i-th entry gets visited. follow_links follows
+    a link only to a directory not listed yet, which breaks every cycle.
+    the walk thread decides in visiting order, so -j visits the same tree.
+*/
+bool follow_entry(PathList *list, int i) {
+    TreeWalk *walk = list->walk;
+    Entry *ent = &list->ent[i];
+    if(!descend(list, ent)) {
+        return false;
+    }
+    if(walk->opt.follow_links && !(ent->flags & ENT_VISITED)) {
+        ent->flags |= ENT_VISITED;
+        if(!insert_sharded_hash_set(&walk->visited, ent->dev, ent->ino) && S_ISLNK(ent->mode)) {
+            ent->flags |= ENT_CYCLE;
+            // it was counted as a sub directory to open
+            release_path_list(list);
+        }
+    }
+    return !(ent->flags & ENT_CYCLE);
+}
+
+/*
+    prune: whether the entry gets visited. a directory does if anything
+    below it does, the search stops at the first file found.
+*/
+bool keep_entry(PathList *list, int i) {
+    TreeWalk *walk = list->walk;
+    // beyond max_depth, a mount point or a cycle nothing is known about it
+    if(!walk->opt.prune || !follow_entry(list, i)) {
+        return true;
+    }
+    PathList *sub_list = sub_path_list(list, i);
+    if(sub_list->content == CONTENT_UNKNOWN) {
+        sub_list->content = CONTENT_EMPTY;
+        for(int j = 0; j < sub_list->top; j++) {
+            if(keep_entry(sub_list, j)) {
+                sub_list->content = CONTENT_FOUND;
+                break;
+            }
+        }
+    }
+    return sub_list->content == CONTENT_FOUND;
+}
+
+/* free a pruned sub tree, keep_entry scanned every listing in it */
+void drop_path_list(PathList *list) {
+    for(int i = 0; list->sub && i < list->top; i++) {
+        if(list->sub[i]) {
+            drop_path_list(list->sub[i]);
+        }
+    }
+    free_path_list(list);
+}
+
+/* index of the first entry from i on that gets visited */
+int next_entry(PathList *list, int i) {
+    while(i < list->top && !keep_entry(list, i)) {
+        drop_path_list(list->sub[i]);
+        list->sub[i] = NULL;
+        i++;
+    }
+    return i;
+}
+
+/* copy the next merged entry of a spilled list into slot, false at the end */
+bool load_spilled(PathList *list, int slot) {
+    Entry *ent = &list->ent[slot];
+    char *name, *link;
+    uint32_t name_len, link_len;
+    if(!next_record(list->spill, ent, &name, &name_len, &link, &link_len)) {
+        return false;
+    }
+    ent->name = arena_push(&list->names, name, name_len);
+    ent->link = link ? arena_push(&list->names, link, link_len) : NO_LINK;
+    list->top = slot + 1;
+    return true;
+}
+
+void visit_list(PathList *list);
+
+/* hand the i-th entry of list and everything below it to the visitor */
+void visit_entry(PathList *list, int i, bool last) {
+    TreeWalk *walk = list->walk;
+    const TreeVisitor *visitor = walk->visitor;
+    Entry *ent = &list->ent[i];
+    bool follow = follow_entry(list, i);
+    uint32_t path_pos = push_path(walk, entry_name(list, ent), ent->name_len);
+    TreeEntry tree_ent = {
+        .name = entry_name(list, ent),
+        .name_len = ent->name_len,
+        .path = walk->cur_path.buf,
+        .path_len = walk->cur_path.used - 1,
+        .link = S_ISLNK(ent->mode) ? entry_link(list, ent) : NULL,
+        .mode = ent->mode,
+        .size = ent->size,
+        .blocks = ent->blocks,
+        .nlink = ent->nlink,
+        .dev = ent->dev,
+        .ino = ent->ino,
+        .mtime_sec = ent->mtime_sec,
+        .mtime_nsec = ent->mtime_nsec,
+        .depth = list->depth,
+        .last = last,
+        .descend = follow,
+        .cycle = ent->flags & ENT_CYCLE
+    };
+    if(visitor->entry) {
+        visitor->entry(visitor->arg, &tree_ent);
+    }
+    if(follow) {
+        PathList *sub_list = sub_path_list(list, i);
+        if(walk->watching) {
+            tree_ent.count = &sub_list->count;
+        }
+        if(visitor->pre) {
+            visitor->pre(visitor->arg, &tree_ent);
+        }
+        visit_list(sub_list);
+        // cur_path may have moved while it grew below
+        tree_ent.path = walk->cur_path.buf;
+        if(visitor->post) {
+            visitor->post(visitor->arg, &tree_ent);
+        }
+    }
+    pop_path(walk, path_pos);
+}
+
+/*
+    a spilled listing is merged while it is visited, ent only ever holds
+    the entry being visited and the one after it, which decides `last`.
+*/
+void visit_spilled_list(PathList *list) {
+    bool more = load_spilled(list, 0);
+    while(more) {
+        more = load_spilled(list, 1);
+        visit_entry(list, 0, !more);
+        if(more) {
+            // slide the next entry and its strings to the front
+            Entry *next = &list->ent[1];
+            uint32_t base = next->name;
+            memmove(list->names.buf, list->names.buf + base, list->names.used - base);
+            list->names.used -= base;
+            next->name -= base;
+            if(next->link != NO_LINK) {
+                next->link -= base;
+            }
+            list->ent[0] = *next;
+            list->top = 1;
+        }
+    }
+    reset_path_list(list, NULL, NULL);
+}
+
+/* visit list and everything below it */
+void visit_list(PathList *list) {
+    TreeWalk *walk = list->walk;
+    if(list->spill) {
+        visit_spilled_list(list);
+        return;
+    }
+    int next;
+    for(int i = next_entry(list, 0); i < list->top; i = next) {
+        next = next_entry(list, i + 1);
+        visit_entry(list, i, next == list->top);
+    }
+    if(walk->watching) {
+        return;
+    } else if(walk->opt.jobs > 1 || walk->opt.prune) {
+        free_path_list(list);
+    } else {
+        reset_path_list(list, NULL, NULL);
+    }
+}
+
+/* the root gets pre() and post() around its listing, at depth -1 */
+void visit_root(TreeWalk *walk, PathList *root) {
+    const TreeVisitor *visitor = walk->visitor;
+    TreeEntry tree_ent = {
+        .name = root->name,
+        .name_len = strlen(root->name),
+        .path = "",
+        .mode = S_IFDIR,
+        .depth = -1,
+        .last = true,
+        .descend = true,
+        .count = walk->watching ? &root->count : NULL
+    };
+    if(visitor->pre) {
+        visitor->pre(visitor->arg, &tree_ent);
+    }
+    visit_list(root);
+    if(visitor->post) {
+        visitor->post(visitor->arg, &tree_ent);
+    }
+}
+
+/*
+    watch mode
+    the whole tree stays in memory as PathList listings linked through sub,
+    every directory has an inotify watch. an event only rescans the listing
+    it happened in, sub directories that still exist keep their model.
+*/
+
+void watch_path_list(PathList *list) {
+    TreeWalk *walk = list->walk;
+    // the watch follows the inode, so the fd is as good as a path
+    char proc_path[64];
+    snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", list->fd);
+    int wd = inotify_add_watch(walk->inotify_fd, proc_path, WATCH_MASK);
+    if(wd < 0) {
+        return;
+    }
+    if(wd >= walk->wd_list_size) {
+        int new_size = walk->wd_list_size ? walk->wd_list_size : 64;
+        while(wd >= new_size) {
+            new_size *= 2;
+        }
+        PathList **new_ptr = realloc(walk->wd_list, sizeof(PathList*) * new_size);
+        if(!new_ptr) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        memset(new_ptr + walk->wd_list_size, 0, sizeof(PathList*) * (new_size - walk->wd_list_size));
+        walk->wd_list = new_ptr;
+        walk->wd_list_size = new_size;
+    }
+    // a directory moved inside the tree gets its old wd back, the new model owns it
+    walk->wd_list[wd] = list;
+    list->wd = wd;
+}
+
+/* what ent adds to the count of its listing, sign -1 takes it off again */
+void count_model_entry(TreeCount *count, Entry *ent, int sign) {
+    if(S_ISLNK(ent->mode)) {
+        count->links += sign;
+    } else if(S_ISREG(ent->mode)) {
+        count->files += sign;
+    } else if(S_ISDIR(ent->mode)) {
+        count->dirs += sign;
+    }
+    count->size += sign * (int64_t)ent->size;
+}
+
+void add_tree_count(TreeCount *count, const TreeCount *delta, int sign) {
+    count->dirs += sign * delta->dirs;
+    count->files += sign * delta->files;
+    count->links += sign * delta->links;
+    count->size += sign * delta->size;
+}
+
+/* a change below list, it goes into every listing up to the root */
+void apply_tree_count(PathList *list, const TreeCount *delta) {
+    for(; list; list = list->parent) {
+        add_tree_count(&list->count, delta, 1);
+    }
+}
+
+/* scan list and every directory below it, counting all of it once */
+void build_model(PathList *list) {
+    scan_path_list(list);
+    list->count = (TreeCount){0};
+    list->sub = calloc(list->top + 1, sizeof(PathList*));
+    for(int i = 0; i < list->top; i++) {
+        count_model_entry(&list->count, &list->ent[i], 1);
+        if(descend(list, &list->ent[i])) {
+            list->sub[i] = new_path_list(list, entry_name(list, &list->ent[i]));
+            build_model(list->sub[i]);
+            add_tree_count(&list->count, &list->sub[i]->count, 1);
+        }
+    }
+}
+
+void free_model(PathList *list) {
+    TreeWalk *walk = list->walk;
+    for(int i = 0; i < list->top; i++) {
+        if(list->sub[i]) {
+            free_model(list->sub[i]);
+        }
+    }
+    if(list->wd >= 0 && walk->wd_list[list->wd] == list) {
+        inotify_rm_watch(walk->inotify_fd, list->wd);
+        walk->wd_list[list->wd] = NULL;
+    }
+    free_path_list(list);
+}
+
+/* open the directory again through the names of its ancestors */
+int reopen_path_list(PathList *list) {
+    if(!list->parent) {
+        return open(list->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    int parent_fd = reopen_path_list(list->parent);
+    if(parent_fd < 0) {
+        return -1;
+    }
+    int fd = openat(parent_fd, list->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    close(parent_fd);
+    return fd;
+}
+
+int find_entry(PathList *list, char *name) {
+    TreeWalk *walk = list->walk;
+    if(walk->opt.sort != SORT_NAME) {
+        for(int i = 0; i < list->top; i++) {
+            if(strcmp(entry_name(list, &list->ent[i]), name) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+    int lo = 0, hi = list->top - 1;
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int res = strcmp(entry_name(list, &list->ent[mid]), name);
+        if(res == 0) {
+            return mid;
+        } else if(res < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+/* something was created, removed or renamed in list */
+void rescan_model(PathList *list) {
+    int fd = reopen_path_list(list);
+    if(fd < 0) {
+        // gone, the parent's own event removes it
+        return;
+    }
+    // keep the old listing around to carry sub directory models over
+    PathList old = *list;
+    list->ent = calloc(1, sizeof(Entry) * 16);
+    list->capacity = 16;
+    list->names = (Arena){0};
+    list->top = 0;
+    list->fd = fd;
+    stat_path_list(list);
+
+    // the old entries and dropped sub trees come off, new ones go on
+    TreeCount delta = {0};
+    for(int i = 0; i < old.top; i++) {
+        count_model_entry(&delta, &old.ent[i], -1);
+    }
+
+    // closed below rather than by the last sub directory to be opened
+    list->unopened = INT_MAX;
+    list->sub = calloc(list->top + 1, sizeof(PathList*));
+    for(int i = 0; i < list->top; i++) {
+        Entry *ent = &list->ent[i];
+        count_model_entry(&delta, ent, 1);
+        if(!descend(list, ent)) {
+            continue;
+        }
+        int j = find_entry(&old, entry_name(list, ent));
+        if(j >= 0 && old.sub[j]) {
+            list->sub[i] = old.sub[j];
+            list->sub[i]->name = entry_name(list, ent);
+            old.sub[j] = NULL;
+        } else {
+            list->sub[i] = new_path_list(list, entry_name(list, ent));
+            build_model(list->sub[i]);
+            add_tree_count(&delta, &list->sub[i]->count, 1);
+        }
+    }
+    close(fd);
+
+    for(int i = 0; i < old.top; i++) {
+        if(old.sub[i]) {
+            add_tree_count(&delta, &old.sub[i]->count, -1);
+            free_model(old.sub[i]);
+        }
+    }
+    apply_tree_count(list, &delta);
+    free(old.ent);
+    free(old.names.buf);
+    free(old.sub);
+}
+
+/* a file changed in place, only its own entry needs a new statx */
+void restat_model(PathList *list, char *name) {
+    int i = find_entry(list, name);
+    if(i < 0) {
+        return;
+    }
+    Entry *ent = &list->ent[i];
+    int fd = reopen_path_list(list);
+    if(fd < 0) {
+        return;
+    }
+    struct statx stx;
+    if(statx(fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, list->walk->stat_mask, &stx) == 0 &&
+       (stx.stx_mode & S_IFMT) == (ent->mode & S_IFMT)) {
+        TreeCount delta = {0};
+        count_model_entry(&delta, ent, -1);
+        batch_done(list, i, 0, &stx);
+        count_model_entry(&delta, ent, 1);
+        apply_tree_count(list, &delta);
+    }
+    close(fd);
+}
+
+void watch_model(TreeWalk *walk, PathList *root) {
+    char buf[INOTIFY_BUF_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int *dirty = NULL;
+    int dirty_top = 0, dirty_capacity = 0;
+    struct pollfd pfd = {.fd = walk->inotify_fd, .events = POLLIN};
+    while(true) {
+        // block for the first event, then collect until things calm down
+        int timeout = -1;
+        while(poll(&pfd, 1, timeout) > 0) {
+            timeout = WATCH_DEBOUNCE_MS;
+            ssize_t len = read(walk->inotify_fd, buf, sizeof(buf));
+            if(len <= 0) {
+                continue;
+            }
+            for(char *ptr = buf; ptr < buf + len;) {
+                struct inotify_event *event = (struct inotify_event *)ptr;
+                ptr += sizeof(struct inotify_event) + event->len;
+                if(event->mask & IN_Q_OVERFLOW) {
+                    // events were lost, start over
+                    const char *root_name = root->name;
+                    free_model(root);
+                    root = new_path_list(NULL, root_name);
+                    root->walk = walk;
+                    build_model(root);
+                    dirty_top = 0;
+                    continue;
+                }
+                if(event->wd < 0 || event->wd >= walk->wd_list_size || !walk->wd_list[event->wd]) {
+                    continue;
+                }
+                if(event->mask & (IN_MODIFY | IN_ATTRIB)) {
+                    if(event->len) {
+                        restat_model(walk->wd_list[event->wd], event->name);
+                    }
+                    continue;
+                }
+                // rescan every dirty directory once per round
+                if(walk->wd_list[event->wd]->dirty) {
+                    continue;
+                }
+                walk->wd_list[event->wd]->dirty = true;
+                if(dirty_top == dirty_capacity) {
+                    dirty_capacity = dirty_capacity ? dirty_capacity * 2 : 64;
+                    dirty = realloc(dirty, sizeof(int) * dirty_capacity);
+                }
+                if(!dirty) {
+                    perror("Memory leak!");
+                    exit(1);
+                }
+                dirty[dirty_top++] = event->wd;
+            }
+        }
+        for(int i = 0; i < dirty_top; i++) {
+            // an earlier rescan may have dropped it already
+            if(walk->wd_list[dirty[i]] && walk->wd_list[dirty[i]]->dirty) {
+                walk->wd_list[dirty[i]]->dirty = false;
+                rescan_model(walk->wd_list[dirty[i]]);
+            }
+        }
+        dirty_top = 0;
+        visit_root(walk, root);
+    }
+}
+
+/* set up what one run needs, false if the root can't be stat'ed */
+bool start_walk(TreeWalk *walk, const char *root, const TreeVisitor *visitor) {
+    struct statx stx;
+    if(statx(AT_FDCWD, root, 0, STATX_INO, &stx) != 0) {
+        return false;
+    }
+    walk->root_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    walk->visitor = visitor;
+    walk->cur_path.used = 0;
+    if(walk->opt.follow_links) {
+        // a directory is told apart by (dev, ino), links to the root are cycles too
+        init_sharded_hash_set(&walk->visited);
+        insert_sharded_hash_set(&walk->visited, walk->root_dev, stx.stx_ino);
+    }
+    if(walk->cache_path) {
+        // include and exclude filter the listings themselves
+        uint64_t filter = hash_matcher(&walk->exclude, hash_matcher(&walk->include, 2166136261u) * 16777619u);
+        walk->cache = open_cache(walk->cache_path, sizeof(Entry),
+                                 walk->opt.skip_hidden | walk->opt.sort << 1 | walk->opt.follow_links << 3 |
+                                 walk->stat_mask << 4 | filter << 32);
+    }
+    return true;
+}
+
+void close_walk_cache(TreeWalk *walk) {
+    if(walk->cache) {
+        close_cache(walk->cache);
+        walk->cache = NULL;
+    }
+}
+
+
+/* public function */
+void default_tree_options(TreeOptions *opt) {
+    memset(opt, 0, sizeof(TreeOptions));
+    opt->jobs = 1;
+    opt->backend = BACKEND_SYNC;
+    opt->sort = SORT_NAME;
+    opt->skip_hidden = true;
+    opt->max_depth = INT_MAX;
+}
+
+TreeWalk *new_tree_walk(const TreeOptions *opt) {
+    // -j and --prune keep listings after they are visited, a spilled one is gone by then
+    if(opt->mem_limit && (opt->jobs > 1 || opt->prune)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    TreeWalk *walk = calloc(1, sizeof(TreeWalk));
+    if(!walk) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    walk->opt = *opt;
+    // nothing is kept of the caller's strings
+    walk->opt.include = walk->opt.exclude = walk->opt.cache_path = NULL;
+    if(opt->include) {
+        add_patterns(&walk->include, opt->include);
+    }
+    if(opt->exclude) {
+        add_patterns(&walk->exclude, opt->exclude);
+    }
+    if(opt->cache_path) {
+        walk->cache_path = strdup(opt->cache_path);
+        if(!walk->cache_path) {
+            perror("Memory leak!");
+            exit(1);
+        }
+    }
+    walk->stat_mask = opt->stat_mask | STATX_TYPE | STATX_MODE | STATX_SIZE;
+    if(opt->follow_links) {
+        walk->stat_mask |= STATX_INO;
+    }
+    walk->backend = init_backend(opt->backend);
+    walk->inotify_fd = -1;
+    pthread_mutex_init(&walk->pool_lock, NULL);
+    pthread_cond_init(&walk->work_cond, NULL);
+    pthread_mutex_init(&walk->ready_lock, NULL);
+    pthread_cond_init(&walk->ready_cond, NULL);
+    return walk;
+}
+
+bool run_tree_walk(TreeWalk *walk, const char *root, const TreeVisitor *visitor) {
+    if(!start_walk(walk, root, visitor)) {
+        return false;
+    }
+    PathList *list;
+    if(walk->opt.jobs > 1) {
+        list = new_path_list(NULL, root);
+        list->walk = walk;
+        start_pool(walk);
+        wait_path_list(list);
+    } else if(walk->opt.prune) {
+        list = new_path_list(NULL, root);
+        list->walk = walk;
+        scan_path_list(list);
+    } else {
+        list = depth_path_list(walk, 0, NULL, root);
+        scan_path_list(list);
+    }
+    visit_root(walk, list);
+    if(walk->opt.jobs > 1) {
+        stop_pool(walk);
+    }
+    close_walk_cache(walk);
+    if(walk->opt.follow_links) {
+        free_sharded_hash_set(&walk->visited);
+    }
+    return true;
+}
+
+bool watch_tree_walk(TreeWalk *walk, const char *root, const TreeVisitor *visitor) {
+    // the model keeps every listing, has no cycle check for links and can't
+    // have pruned listings freed under the inotify watches pointing at them
+    if(walk->opt.mem_limit || walk->opt.follow_links || walk->opt.prune) {
+        errno = EINVAL;
+        return false;
+    }
+    walk->inotify_fd = inotify_init1(IN_CLOEXEC);
+    if(walk->inotify_fd < 0 || !start_walk(walk, root, visitor)) {
+        return false;
+    }
+    walk->watching = true;
+    PathList *list = new_path_list(NULL, root);
+    list->walk = walk;
+    build_model(list);
+    // the cache only saves the first scan
+    close_walk_cache(walk);
+    visit_root(walk, list);
+    watch_model(walk, list);
+    return true;
+}
+
+void free_tree_walk(TreeWalk *walk) {
+    for(int i = 0; i < walk->depth_list_size; i++) {
+        if(walk->depth_list[i]) {
+            free_path_list(walk->depth_list[i]);
+        }
+    }
+    free(walk->depth_list);
+    free(walk->cur_path.buf);
+    free(walk->wd_list);
+    if(walk->inotify_fd >= 0) {
+        close(walk->inotify_fd);
+    }
+    free_matcher(&walk->include);
+    free_matcher(&walk->exclude);
+    free(walk->cache_path);
+    pthread_mutex_destroy(&walk->pool_lock);
+    pthread_cond_destroy(&walk->work_cond);
+    pthread_mutex_destroy(&walk->ready_lock);
+    pthread_cond_destroy(&walk->ready_cond);
+    free(walk);
+    // the walk thread sorted too, it may well be done with walking
+    free_thread_scratch();
+}
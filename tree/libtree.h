@@ -0,0 +1,109 @@
+#ifndef _LIBTREE_H
+#define _LIBTREE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+    libtree, the directory walker behind my_tree
+
+    a TreeWalk holds its options, worker threads and every listing, no
+    state is shared between walks, so several of them can run at once in
+    one process. --stats counters are the exception, they are summed over
+    the whole process, and so is the thread pool of BACKEND_THREADS.
+
+    the visitor is always called from the thread running the walk, in
+    print order: pre(dir), entry() for every entry of dir, each directory
+    entry followed by its own pre() ... post(), then post(dir). the root
+    gets pre() and post() only, with depth -1.
+*/
+
+#define MIN_MEM_LIMIT (1 << 20)
+
+/* what a walk lists, default_tree_options fills in my_tree's defaults */
+typedef struct TreeOptions TreeOptions;
+struct TreeOptions {
+    // walker threads, 1 = walk in the calling thread
+    int jobs;
+    // how every directory gets stat'ed and listings are ordered, see backend.h and sort.h
+    int backend, sort;
+    bool skip_hidden;
+    // levels listed below the root
+    int max_depth;
+    // -P keeps only files matching, -I drops files and directories matching, NULL = none
+    const char *include, *exclude;
+    // leave out directories with nothing left to list below them, not with watch_tree_walk
+    bool prune;
+    // follow symlinks to directories, each directory is listed once that way,
+    // not with watch_tree_walk
+    bool follow_links;
+    // stay on the file system of the root
+    bool one_file_system;
+    // bytes a listing may take before it is spilled to sorted runs, 0 = no limit,
+    // below MIN_MEM_LIMIT it would only make a lot of tiny runs. only with
+    // jobs = 1 and no prune, a spilled listing is merged while it is visited
+    // and can't be kept, watch_tree_walk doesn't take it either
+    size_t mem_limit;
+    // index of the previous run, rewritten after every run, NULL = no cache
+    const char *cache_path;
+    // statx fields wanted on top of type, mode and size, e.g. STATX_BLOCKS
+    unsigned int stat_mask;
+};
+
+/* what a sub tree holds, size sums every entry including directories */
+typedef struct TreeCount TreeCount;
+struct TreeCount {
+    int64_t dirs, files, links, size;
+};
+
+/* one entry as handed to the visitor, valid until the callback returns */
+typedef struct TreeEntry TreeEntry;
+struct TreeEntry {
+    const char *name;
+    size_t name_len;
+    // "a/b/c" relative to the root, "" for the root itself
+    const char *path;
+    size_t path_len;
+    // symlink target, NULL for other types
+    const char *link;
+    mode_t mode;
+    uint64_t size, blocks, nlink, dev, ino;
+    int64_t mtime_sec;
+    uint32_t mtime_nsec;
+    // 0 for the entries of the root listing
+    int depth;
+    // no entry of the same listing follows
+    bool last;
+    // the listing of this entry follows, between pre() and post()
+    bool descend;
+    // a followed link to a directory listed already
+    bool cycle;
+    // watch_tree_walk only, in pre() and post(): everything below the directory.
+    // the model keeps it up to date per event, nothing is recounted for a redraw
+    const TreeCount *count;
+};
+
+typedef struct TreeVisitor TreeVisitor;
+struct TreeVisitor {
+    void (*pre)(void *arg, const TreeEntry *dir);
+    void (*entry)(void *arg, const TreeEntry *ent);
+    void (*post)(void *arg, const TreeEntry *dir);
+    void *arg;
+};
+
+typedef struct TreeWalk TreeWalk;
+
+void default_tree_options(TreeOptions *opt);
+// the strings of opt are copied, NULL with errno EINVAL if opt can't be combined
+TreeWalk *new_tree_walk(const TreeOptions *opt);
+// false if root can't be stat'ed, errno tells why
+bool run_tree_walk(TreeWalk *walk, const char *root, const TreeVisitor *visitor);
+// visit root again after every burst of changes, only returns false like run_tree_walk,
+// or with EINVAL for a walk with mem_limit, prune or follow_links
+bool watch_tree_walk(TreeWalk *walk, const char *root, const TreeVisitor *visitor);
+void free_tree_walk(TreeWalk *walk);
+
+#endif
@@ -0,0 +1,193 @@
+#include "match.h"
+
+/*
+    [...] starting right after the '[', c is the name byte to test.
+    return the pattern right after the ']', NULL if the class never ends.
+*/
+const char *match_class(const char *p, const char *end, unsigned char c, bool *hit) {
+    bool negate = false, found = false;
+    if(p < end && (*p == '!' || *p == '^')) {
+        negate = true;
+        p++;
+    }
+    // a leading ']' is part of the class
+    const char *start = p;
+    while(p < end && (*p != ']' || p == start)) {
+        unsigned char lo, hi;
+        if(*p == '\\' && p + 1 < end) {
+            p++;
+        }
+        lo = hi = *p++;
+        if(p + 1 < end && *p == '-' && p[1] != ']') {
+            p++;
+            if(*p == '\\' && p + 1 < end) {
+                p++;
+            }
+            hi = *p++;
+        }
+        if(lo <= c && c <= hi) {
+            found = true;
+        }
+    }
+    if(p >= end) {
+        return NULL;
+    }
+    *hit = found != negate;
+    return p + 1;
+}
+
+/* fnmatch without flags, a '*' backtracks only to the last star seen */
+bool match_glob(const char *p, const char *pend, const char *s, const char *send) {
+    const char *star_p = NULL, *star_s = NULL;
+    while(s < send) {
+        if(p < pend && *p == '*') {
+            star_p = ++p;
+            star_s = s;
+            continue;
+        }
+        if(p < pend) {
+            bool hit = false;
+            const char *next = NULL;
+            if(*p == '?') {
+                hit = true;
+                next = p + 1;
+            } else if(*p == '[') {
+                next = match_class(p + 1, pend, *s, &hit);
+            }
+            // plain byte, or a '[' that never closes
+            if(!next) {
+                const char *q = p;
+                if(*q == '\\' && q + 1 < pend) {
+                    q++;
+                }
+                hit = *q == *s;
+                next = q + 1;
+            }
+            if(hit) {
+                p = next;
+                s++;
+                continue;
+            }
+        }
+        if(!star_p) {
+            return false;
+        }
+        p = star_p;
+        s = ++star_s;
+    }
+    while(p < pend && *p == '*') {
+        p++;
+    }
+    return p == pend;
+}
+
+void compile_pattern(Pattern *pat, const char *str, size_t len) {
+    int stars = 0;
+    bool special = false;
+    for(size_t i = 0; i < len; i++) {
+        if(str[i] == '*') {
+            stars++;
+        } else if(str[i] == '?' || str[i] == '[' || str[i] == '\\') {
+            special = true;
+        }
+    }
+    pat->kind = PATTERN_GLOB;
+    if(special || stars > 1) {
+        // keep the whole pattern
+    } else if(stars == 0) {
+        pat->kind = PATTERN_LITERAL;
+    } else if(len == 1) {
+        pat->kind = PATTERN_ANY;
+    } else if(str[0] == '*') {
+        pat->kind = PATTERN_SUFFIX;
+        str++;
+        len--;
+    } else if(str[len - 1] == '*') {
+        pat->kind = PATTERN_PREFIX;
+        len--;
+    }
+    pat->str = strndup(str, len);
+    pat->len = len;
+    if(!pat->str) {
+        perror("Memory leak!");
+        exit(1);
+    }
+}
+
+
+/* public function */
+
+/* add every '|' separated pattern of patterns, e.g. "node_modules|*.o" */
+void add_patterns(Matcher *matcher, const char *patterns) {
+    while(true) {
+        const char *end = strchr(patterns, '|');
+        size_t len = end ? (size_t)(end - patterns) : strlen(patterns);
+        if(len) {
+            if(matcher->n == matcher->capacity) {
+                matcher->capacity = matcher->capacity ? matcher->capacity * 2 : 4;
+                Pattern *new_ptr = realloc(matcher->pat, sizeof(Pattern) * matcher->capacity);
+                if(!new_ptr) {
+                    perror("Memory leak!");
+                    exit(1);
+                }
+                matcher->pat = new_ptr;
+            }
+            compile_pattern(&matcher->pat[matcher->n++], patterns, len);
+        }
+        if(!end) {
+            return;
+        }
+        patterns = end + 1;
+    }
+}
+
+bool match_name(Matcher *matcher, const char *name, size_t len) {
+    for(int i = 0; i < matcher->n; i++) {
+        Pattern *pat = &matcher->pat[i];
+        switch(pat->kind) {
+            case PATTERN_ANY:
+                return true;
+            case PATTERN_LITERAL:
+                if(len == pat->len && memcmp(name, pat->str, len) == 0) {
+                    return true;
+                }
+                break;
+            case PATTERN_PREFIX:
+                if(len >= pat->len && memcmp(name, pat->str, pat->len) == 0) {
+                    return true;
+                }
+                break;
+            case PATTERN_SUFFIX:
+                if(len >= pat->len && memcmp(name + len - pat->len, pat->str, pat->len) == 0) {
+                    return true;
+                }
+                break;
+            default:
+                if(match_glob(pat->str, pat->str + pat->len, name, name + len)) {
+                    return true;
+                }
+        }
+    }
+    return false;
+}
+
+/* fold the patterns into hash (fnv-1a), listings filtered differently must not share a cache */
+uint32_t hash_matcher(Matcher *matcher, uint32_t hash) {
+    for(int i = 0; i < matcher->n; i++) {
+        Pattern *pat = &matcher->pat[i];
+        hash = (hash ^ pat->kind) * 16777619u;
+        for(size_t j = 0; j < pat->len; j++) {
+            hash = (hash ^ (unsigned char)pat->str[j]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+void free_matcher(Matcher *matcher) {
+    for(int i = 0; i < matcher->n; i++) {
+        free(matcher->pat[i].str);
+    }
+    free(matcher->pat);
+    matcher->n = matcher->capacity = 0;
+    matcher->pat = NULL;
+}
@@ -0,0 +1,39 @@
+#ifndef _MATCH_H
+#define _MATCH_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* how a compiled pattern is checked, globs fall back to the general matcher */
+enum PatternKind {
+    PATTERN_ANY,        // *
+    PATTERN_LITERAL,    // node_modules
+    PATTERN_PREFIX,     // build*
+    PATTERN_SUFFIX,     // *.o
+    PATTERN_GLOB        // anything with ? [ ] \ or more than one *
+};
+
+typedef struct Pattern Pattern;
+struct Pattern {
+    int kind;
+    // the pattern, or only its literal part for LITERAL, PREFIX and SUFFIX
+    char *str;
+    size_t len;
+};
+
+/* every pattern given to -P or -I, a name matches if any of them does */
+typedef struct Matcher Matcher;
+struct Matcher {
+    int n, capacity;
+    Pattern *pat;
+};
+
+void add_patterns(Matcher *matcher, const char *patterns);
+bool match_name(Matcher *matcher, const char *name, size_t len);
+uint32_t hash_matcher(Matcher *matcher, uint32_t hash);
+void free_matcher(Matcher *matcher);
+
+#endif
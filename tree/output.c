@@ -0,0 +1,184 @@
+#include "output.h"
+
+/* private global var */
+char *out_buf = NULL;
+size_t out_len = 0, out_capacity = 0;
+// position of out_buf[0] in the whole output
+off_t out_base = 0;
+// reserved fields waiting for out_patch, oldest first
+off_t *held = NULL;
+int held_top = 0, held_capacity = 0;
+// stdout is a regular file, fields that were already flushed get pwrite'd
+int seekable = -1;
+off_t file_start = 0;
+
+// "│   " or "    " for every depth, prefix_end[i] = length of the first i segments
+char *prefix;
+size_t prefix_len = 0, prefix_capacity = 0;
+size_t *prefix_end;
+int prefix_depth = 0, prefix_depth_capacity = 0;
+
+
+/* output buffer */
+void write_all(const char *str, size_t len) {
+    uint64_t start = phase_start();
+    while(len) {
+        ssize_t n = write(STDOUT_FILENO, str, len);
+        count_call(CALL_WRITE, 1);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            // reader is gone, e.g. piped into head
+            exit(1);
+        }
+        str += n;
+        len -= n;
+    }
+    phase_end(PHASE_OUTPUT, start);
+}
+
+void out_flush() {
+    // a pipe can't take a field back, keep everything from the oldest one
+    size_t len = out_len;
+    if(held_top && !seekable) {
+        len = held[0] - out_base;
+    }
+    if(!len) {
+        return;
+    }
+    write_all(out_buf, len);
+    memmove(out_buf, out_buf + len, out_len - len);
+    out_len -= len;
+    out_base += len;
+}
+
+/* make room for len more bytes, growing only while fields are held */
+void out_reserve_space(size_t len) {
+    if(out_len + len <= out_capacity) {
+        return;
+    }
+    out_flush();
+    if(out_len + len > out_capacity) {
+        size_t capacity = out_capacity ? out_capacity : OUT_BUF_SIZE;
+        while(out_len + len > capacity) {
+            capacity <<= 1;
+        }
+        char *new_ptr = realloc(out_buf, capacity);
+        if(!new_ptr) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        out_buf = new_ptr;
+        out_capacity = capacity;
+    }
+}
+
+void out_write(const char *str, size_t len) {
+    if(!len) {
+        return;
+    }
+    // too long to be worth copying
+    if(len > OUT_BUF_SIZE && !held_top) {
+        out_flush();
+        write_all(str, len);
+        out_base += len;
+        return;
+    }
+    out_reserve_space(len);
+    memcpy(out_buf + out_len, str, len);
+    out_len += len;
+}
+
+void out_str(const char *str) {
+    out_write(str, strlen(str));
+}
+
+void out_char(char c) {
+    out_reserve_space(1);
+    out_buf[out_len++] = c;
+}
+
+void out_printf(const char *fmt, ...) {
+    char buf[1024];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if(len > 0) {
+        out_write(buf, len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1);
+    }
+}
+
+
+/* fields */
+off_t out_reserve(size_t len) {
+    if(seekable < 0) {
+        struct stat st;
+        int flags = fcntl(STDOUT_FILENO, F_GETFL);
+        off_t cur = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+        // pwrite ignores the offset on O_APPEND files
+        seekable = cur >= 0 && flags >= 0 && !(flags & O_APPEND) &&
+                   fstat(STDOUT_FILENO, &st) == 0 && S_ISREG(st.st_mode);
+        file_start = cur - out_base;
+    }
+    if(held_top == held_capacity) {
+        held_capacity = held_capacity ? held_capacity * 2 : 64;
+        held = realloc(held, sizeof(off_t) * held_capacity);
+        if(!held) {
+            perror("Memory leak!");
+            exit(1);
+        }
+    }
+    off_t pos = out_base + out_len;
+    held[held_top++] = pos;
+    out_reserve_space(len);
+    memset(out_buf + out_len, ' ', len);
+    out_len += len;
+    return pos;
+}
+
+void out_patch(off_t pos, const char *str, size_t len) {
+    if(pos >= out_base) {
+        memcpy(out_buf + (pos - out_base), str, len);
+    } else {
+        uint64_t start = phase_start();
+        if(pwrite(STDOUT_FILENO, str, len, file_start + pos) < 0) {
+            perror("my_tree: pwrite");
+        }
+        count_call(CALL_PWRITE, 1);
+        phase_end(PHASE_OUTPUT, start);
+    }
+    held_top--;
+}
+
+
+/* prefix */
+void push_prefix(bool last) {
+    const char *segment = last ? "    " : "│   ";
+    size_t len = strlen(segment);
+    if(prefix_len + len > prefix_capacity) {
+        prefix_capacity = prefix_capacity ? prefix_capacity * 2 : 256;
+        prefix = realloc(prefix, prefix_capacity);
+    }
+    if(prefix_depth + 1 >= prefix_depth_capacity) {
+        prefix_depth_capacity = prefix_depth_capacity ? prefix_depth_capacity * 2 : 64;
+        prefix_end = realloc(prefix_end, sizeof(size_t) * prefix_depth_capacity);
+    }
+    if(!prefix || !prefix_end) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    memcpy(prefix + prefix_len, segment, len);
+    prefix_len += len;
+    prefix_end[++prefix_depth] = prefix_len;
+}
+
+void pop_prefix() {
+    prefix_depth--;
+    prefix_len = prefix_depth ? prefix_end[prefix_depth] : 0;
+}
+
+void out_prefix() {
+    out_write(prefix, prefix_len);
+}
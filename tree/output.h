@@ -0,0 +1,43 @@
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "stats.h"
+
+#define OUT_BUF_SIZE (1 << 16)
+
+/* ansi colour */
+#define COLOR_DIR "\033[1;96m"
+#define COLOR_LINK "\033[1;95m"
+#define COLOR_EXEC "\033[1;91m"
+#define COLOR_RESET "\033[0m"
+
+/* buffered stdout, flushed with write once the buffer is full */
+void out_write(const char *str, size_t len);
+void out_str(const char *str);
+void out_char(char c);
+void out_printf(const char *fmt, ...);
+void out_flush();
+
+/*
+    fixed width field filled in later, e.g. a size only known after the
+    sub tree is printed. fields must be patched in reverse order.
+*/
+off_t out_reserve(size_t len);
+void out_patch(off_t pos, const char *str, size_t len);
+
+/* tree prefix, one segment per depth above the current entry */
+void push_prefix(bool last);
+void pop_prefix();
+void out_prefix();
+
+#endif
@@ -0,0 +1,115 @@
+#include "sort.h"
+
+/*
+    MSD radix sort over packed strings
+    the first 8 bytes of every key are cached big endian in prefix, so the
+    first passes and most comparisons never touch the string itself.
+*/
+typedef struct SortItem SortItem;
+struct SortItem {
+    uint64_t prefix;
+    uint32_t key, idx;
+};
+
+uint64_t key_prefix(const char *key) {
+    uint64_t prefix = 0;
+    for(int i = 0; i < 8; i++) {
+        prefix <<= 8;
+        if(*key) {
+            prefix |= (unsigned char)*key++;
+        }
+    }
+    return prefix;
+}
+
+/* byte at depth, every key in the bucket is known to be at least depth long */
+unsigned int item_byte(SortItem *item, int depth, const char *keys) {
+    if(depth < 8) {
+        return (item->prefix >> (56 - 8 * depth)) & 0xff;
+    }
+    return (unsigned char)keys[item->key + depth];
+}
+
+int cmp_item(SortItem *a, SortItem *b, const char *keys) {
+    if(a->prefix != b->prefix) {
+        return a->prefix < b->prefix ? -1 : 1;
+    }
+    // both ended inside the prefix
+    if(!(a->prefix & 0xff)) {
+        return 0;
+    }
+    return strcmp(keys + a->key + 8, keys + b->key + 8);
+}
+
+void insertion_sort(SortItem *item, int n, const char *keys) {
+    for(int i = 1; i < n; i++) {
+        SortItem cur = item[i];
+        int j = i - 1;
+        while(j >= 0 && cmp_item(&item[j], &cur, keys) > 0) {
+            item[j + 1] = item[j];
+            j--;
+        }
+        item[j + 1] = cur;
+    }
+}
+
+void msd_sort(SortItem *item, SortItem *tmp, int n, int depth, const char *keys) {
+    if(n < RADIX_CUTOFF) {
+        insertion_sort(item, n, keys);
+        return;
+    }
+    int count[257] = {0};
+    for(int i = 0; i < n; i++) {
+        count[item_byte(&item[i], depth, keys) + 1]++;
+    }
+    for(int i = 1; i < 257; i++) {
+        count[i] += count[i - 1];
+    }
+    int start[256];
+    memcpy(start, count, sizeof(start));
+    for(int i = 0; i < n; i++) {
+        tmp[count[item_byte(&item[i], depth, keys)]++] = item[i];
+    }
+    memcpy(item, tmp, sizeof(SortItem) * n);
+    // bucket 0 holds keys that ended, they are all equal
+    for(int b = 1; b < 256; b++) {
+        int size = count[b] - start[b];
+        if(size > 1) {
+            msd_sort(item + start[b], tmp, size, depth + 1, keys);
+        }
+    }
+}
+
+// scratch space of the calling thread, kept between calls
+__thread SortItem *scratch = NULL;
+__thread int scratch_size = 0;
+
+/* public function */
+void radix_sort_keys(const char *keys, const uint32_t *key_off, int n, uint32_t *order) {
+    if(n * 2 > scratch_size) {
+        scratch_size = n * 2;
+        free(scratch);
+        scratch = malloc(sizeof(SortItem) * scratch_size);
+        if(!scratch) {
+            perror("Memory leak!");
+            exit(1);
+        }
+    }
+    SortItem *item = scratch;
+    for(int i = 0; i < n; i++) {
+        item[i].prefix = key_prefix(keys + key_off[i]);
+        item[i].key = key_off[i];
+        item[i].idx = i;
+    }
+    msd_sort(item, item + n, n, 0, keys);
+    for(int i = 0; i < n; i++) {
+        order[i] = item[i].idx;
+    }
+}
+
+/* a thread about to exit lets go of its scratch space */
+void free_sort_scratch() {
+    free(scratch);
+    scratch = NULL;
+    scratch_size = 0;
+}
@@ -0,0 +1,26 @@
+#ifndef _SORT_H
+#define _SORT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+// below this a bucket is finished with insertion sort
+#define RADIX_CUTOFF 32
+
+/* how sort() orders a listing */
+enum SortMode {
+    SORT_NAME,
+    SORT_LOCALE,
+    SORT_NONE
+};
+
+/*
+    order[i] = index of the i-th smallest key, keys compare like strcmp.
+    key i is the '\0' terminated string at keys + key_off[i].
+*/
+void radix_sort_keys(const char *keys, const uint32_t *key_off, int n, uint32_t *order);
+void free_sort_scratch();
+
+#endif
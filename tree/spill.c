@@ -0,0 +1,303 @@
+#include "spill.h"
+
+#include <errno.h>
+
+/* private function */
+FILE *temp_file() {
+    const char *dir = getenv("TMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/my_tree.XXXXXX", dir && *dir ? dir : "/tmp");
+    int fd = mkstemp(path);
+    if(fd < 0) {
+        perror("my_tree: spill");
+        exit(1);
+    }
+    // gone from the directory, the space is freed with the last close
+    unlink(path);
+    FILE *file = fdopen(fd, "w+");
+    if(!file) {
+        perror("my_tree: spill");
+        exit(1);
+    }
+    setvbuf(file, NULL, _IOFBF, SPILL_BUF_SIZE);
+    return file;
+}
+
+/* copy len bytes of run into buf, refilling its read ahead buffer with pread */
+void read_fully(Spill *spill, Run *run, void *buf, size_t len) {
+    char *dst = buf;
+    while(len) {
+        if(run->buf_pos == run->buf_len) {
+            size_t want = run->end - run->pos < SPILL_BUF_SIZE ? run->end - run->pos : SPILL_BUF_SIZE;
+            ssize_t got = want ? pread(fileno(spill->file), run->buf, want, run->pos) : 0;
+            if(got <= 0) {
+                // the run ends in the middle of a record
+                if(got == 0) {
+                    errno = EIO;
+                }
+                perror("my_tree: spill");
+                exit(1);
+            }
+            run->pos += got;
+            run->buf_pos = 0;
+            run->buf_len = got;
+        }
+        size_t n = run->buf_len - run->buf_pos < len ? run->buf_len - run->buf_pos : len;
+        memcpy(dst, run->buf + run->buf_pos, n);
+        run->buf_pos += n;
+        dst += n;
+        len -= n;
+    }
+}
+
+/* load the next record of run, done once it runs out */
+void advance_run(Spill *spill, Run *run) {
+    if(run->buf_pos == run->buf_len && run->pos == run->end) {
+        run->done = true;
+        // only the record handed out last is still needed
+        free(run->buf);
+        run->buf = NULL;
+        return;
+    }
+    read_fully(spill, run, &run->head, sizeof(SpillHeader));
+    size_t link_len = run->head.link_len == NO_SPILL_LINK ? 0 : run->head.link_len;
+    size_t len = run->head.name_len + link_len + 2;
+    if(len > run->name_capacity) {
+        char *new_ptr = realloc(run->name, len);
+        if(!new_ptr) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        run->name = new_ptr;
+        run->name_capacity = len;
+    }
+    read_fully(spill, run, run->ent, spill->entry_size);
+    read_fully(spill, run, run->name, run->head.name_len);
+    run->name[run->head.name_len] = '\0';
+    char *link = run->name + run->head.name_len + 1;
+    read_fully(spill, run, link, link_len);
+    link[link_len] = '\0';
+}
+
+/* whether run a goes before run b, equal names keep the run order */
+bool run_less(Spill *spill, int a, int b) {
+    if(spill->order != SORT_NONE) {
+        int res = spill->order == SORT_LOCALE ? strcoll(spill->run[a].name, spill->run[b].name)
+                                              : strcmp(spill->run[a].name, spill->run[b].name);
+        if(res) {
+            return res < 0;
+        }
+    }
+    return a < b;
+}
+
+void sift_down(Spill *spill, int i) {
+    int *heap = spill->heap;
+    while(true) {
+        int min = i, l = 2 * i + 1, r = l + 1;
+        if(l < spill->heap_top && run_less(spill, heap[l], heap[min])) {
+            min = l;
+        }
+        if(r < spill->heap_top && run_less(spill, heap[r], heap[min])) {
+            min = r;
+        }
+        if(min == i) {
+            return;
+        }
+        int tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = min;
+    }
+}
+
+void close_run(Run *run) {
+    free(run->buf);
+    free(run->ent);
+    free(run->name);
+    memset(run, 0, sizeof(Run));
+}
+
+/* read the first record of runs first to last - 1 and heap them up for next_record */
+void open_runs(Spill *spill, int first, int last) {
+    spill->heap_top = 0;
+    spill->handed = false;
+    for(int i = first; i < last; i++) {
+        Run *run = &spill->run[i];
+        run->buf = malloc(SPILL_BUF_SIZE);
+        run->ent = malloc(spill->entry_size);
+        if(!run->buf || !run->ent) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        advance_run(spill, run);
+        if(!run->done) {
+            spill->heap[spill->heap_top++] = i;
+        }
+    }
+    for(int i = spill->heap_top / 2 - 1; i >= 0; i--) {
+        sift_down(spill, i);
+    }
+}
+
+void write_record(Spill *spill, FILE *file, const void *ent, const char *name, uint32_t name_len,
+                  const char *link, uint32_t link_len) {
+    SpillHeader head = {name_len, link ? link_len : NO_SPILL_LINK};
+    if(fwrite(&head, sizeof(head), 1, file) != 1 ||
+       fwrite(ent, spill->entry_size, 1, file) != 1 ||
+       fwrite(name, 1, name_len, file) != name_len ||
+       (link && fwrite(link, 1, link_len, file) != link_len)) {
+        perror("my_tree: spill");
+        exit(1);
+    }
+}
+
+/*
+    runs merged at once: a read buffer each, and the stdio buffers of the
+    spill file and of the file a pass writes, all in half of mem_limit
+*/
+int merge_fan_in(Spill *spill) {
+    size_t bufs = spill->mem_limit / 2 / SPILL_BUF_SIZE;
+    return bufs > 4 ? (int)(bufs - 2) : 2;
+}
+
+/* merge every group of fan_in runs into one run of a new spill file */
+void merge_pass(Spill *spill, int fan_in) {
+    FILE *out = temp_file();
+    char *ent = malloc(spill->entry_size);
+    if(!ent) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    int n = 0;
+    for(int first = 0; first < spill->n; first += fan_in) {
+        int last = first + fan_in < spill->n ? first + fan_in : spill->n;
+        off_t start = ftello(out);
+        open_runs(spill, first, last);
+        char *name, *link;
+        uint32_t name_len, link_len;
+        while(next_record(spill, ent, &name, &name_len, &link, &link_len)) {
+            write_record(spill, out, ent, name, name_len, link, link_len);
+        }
+        for(int i = first; i < last; i++) {
+            close_run(&spill->run[i]);
+        }
+        // n <= first, every run up to here is merged already
+        spill->run[n].pos = start;
+        spill->run[n].end = ftello(out);
+        n++;
+    }
+    free(ent);
+    fclose(spill->file);
+    spill->file = out;
+    spill->n = n;
+    if(fflush(out) != 0) {
+        perror("my_tree: spill");
+        exit(1);
+    }
+}
+
+
+/* public function */
+Spill *new_spill(size_t entry_size, int order, size_t mem_limit) {
+    Spill *spill = calloc(1, sizeof(Spill));
+    if(!spill) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    spill->entry_size = entry_size;
+    spill->order = order;
+    spill->mem_limit = mem_limit;
+    return spill;
+}
+
+/* every record from here on goes to a new run */
+void begin_run(Spill *spill) {
+    if(!spill->file) {
+        spill->file = temp_file();
+    }
+    if(spill->n == spill->capacity) {
+        spill->capacity = spill->capacity ? spill->capacity * 2 : 8;
+        Run *new_ptr = realloc(spill->run, sizeof(Run) * spill->capacity);
+        if(!new_ptr) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        spill->run = new_ptr;
+    }
+    // the previous run ends where this one starts
+    off_t pos = ftello(spill->file);
+    if(spill->n) {
+        spill->run[spill->n - 1].end = pos;
+    }
+    Run *run = &spill->run[spill->n++];
+    memset(run, 0, sizeof(Run));
+    run->pos = pos;
+}
+
+/* append to the current run, records of a run must come in order */
+void spill_record(Spill *spill, const void *ent, const char *name, uint32_t name_len,
+                  const char *link, uint32_t link_len) {
+    write_record(spill, spill->file, ent, name, name_len, link, link_len);
+    spill->count++;
+}
+
+/* end the last run, merge in passes until one merge takes every run, then read their first records */
+void start_merge(Spill *spill) {
+    // runs are read back with pread, nothing may stay in the stdio buffer
+    if(fflush(spill->file) != 0) {
+        perror("my_tree: spill");
+        exit(1);
+    }
+    spill->run[spill->n - 1].end = ftello(spill->file);
+    int fan_in = merge_fan_in(spill);
+    spill->heap = malloc(sizeof(int) * (spill->n < fan_in ? spill->n : fan_in));
+    if(!spill->heap) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    while(spill->n > fan_in) {
+        merge_pass(spill, fan_in);
+    }
+    open_runs(spill, 0, spill->n);
+}
+
+/*
+    smallest record left, false once every run is done. name and link stay
+    valid until the next call, link is NULL if the record has none.
+*/
+bool next_record(Spill *spill, void *ent, char **name, uint32_t *name_len,
+                 char **link, uint32_t *link_len) {
+    if(spill->handed && spill->heap_top) {
+        // the run handed out last time is still on top of the heap
+        Run *top = &spill->run[spill->heap[0]];
+        advance_run(spill, top);
+        if(top->done) {
+            spill->heap[0] = spill->heap[--spill->heap_top];
+        }
+        sift_down(spill, 0);
+    }
+    if(!spill->heap_top) {
+        return false;
+    }
+    spill->handed = true;
+    Run *run = &spill->run[spill->heap[0]];
+    memcpy(ent, run->ent, spill->entry_size);
+    *name = run->name;
+    *name_len = run->head.name_len;
+    *link = run->head.link_len == NO_SPILL_LINK ? NULL : run->name + run->head.name_len + 1;
+    *link_len = run->head.link_len;
+    return true;
+}
+
+void free_spill(Spill *spill) {
+    if(spill->file) {
+        fclose(spill->file);
+    }
+    for(int i = 0; i < spill->n; i++) {
+        close_run(&spill->run[i]);
+    }
+    free(spill->run);
+    free(spill->heap);
+    free(spill);
+}
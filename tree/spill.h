@@ -0,0 +1,73 @@
+#ifndef _SPILL_H
+#define _SPILL_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sort.h"
+
+#define SPILL_BUF_SIZE (1 << 16)
+#define NO_SPILL_LINK UINT32_MAX
+
+/*
+    external merge sort of one listing. sorted runs are written one after
+    another to an unlinked temp file, then merged back one entry at a time.
+    a run being merged reads ahead SPILL_BUF_SIZE bytes, runs are merged
+    while those buffers fit in half of mem_limit. more runs than that get
+    merged in passes first, groups of runs into one run each in a new file,
+    so the merge holds at most two fds whatever the number of runs.
+
+    record: SpillHeader, entry (entry_size bytes), name, link target
+*/
+typedef struct SpillHeader SpillHeader;
+struct SpillHeader {
+    // link_len = NO_SPILL_LINK for everything but symlinks
+    uint32_t name_len, link_len;
+};
+
+/* the next record of one run, read ahead for the merge */
+typedef struct Run Run;
+struct Run {
+    // what is left of the run in the spill file, buf holds what was read of it
+    off_t pos, end;
+    char *buf;
+    size_t buf_pos, buf_len;
+    SpillHeader head;
+    char *ent;
+    char *name;
+    size_t name_capacity;
+    bool done;
+};
+
+typedef struct Spill Spill;
+struct Spill {
+    size_t entry_size;
+    // SORT_NAME, SORT_LOCALE or SORT_NONE, runs are already sorted the same way
+    int order;
+    // what the merge buffers may take, see above
+    size_t mem_limit;
+    // every run, written through the stdio buffer and read back with pread
+    FILE *file;
+    int n, capacity;
+    Run *run;
+    // min heap of run indices while merging, the top run moves on at the next call
+    int *heap;
+    int heap_top;
+    bool handed;
+    uint64_t count;
+};
+
+Spill *new_spill(size_t entry_size, int order, size_t mem_limit);
+void begin_run(Spill *spill);
+void spill_record(Spill *spill, const void *ent, const char *name, uint32_t name_len,
+                  const char *link, uint32_t link_len);
+void start_merge(Spill *spill);
+bool next_record(Spill *spill, void *ent, char **name, uint32_t *name_len,
+                 char **link, uint32_t *link_len);
+void free_spill(Spill *spill);
+
+#endif
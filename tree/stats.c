@@ -0,0 +1,219 @@
+#include "stats.h"
+
+bool stats_enabled = false;
+
+/* private global var */
+// every thread's counters, pushed once and never removed
+Stats *all_stats = NULL;
+__thread Stats *thread_stats = NULL;
+uint64_t start_ns;
+
+const char *phase_names[PHASE_COUNT] = {
+    "open", "readdir", "stat", "readlink", "sort", "cache", "output"
+};
+
+const char *call_names[CALL_COUNT] = {
+    "openat", "close", "getdents64", "statx", "readlinkat", "write", "pwrite",
+    "io_uring_enter", "io_uring_statx"
+};
+
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+Stats *my_stats() {
+    if(!thread_stats) {
+        thread_stats = calloc(1, sizeof(Stats));
+        if(!thread_stats) {
+            perror("Memory leak!");
+            exit(1);
+        }
+        thread_stats->next = __atomic_load_n(&all_stats, __ATOMIC_RELAXED);
+        while(!__atomic_compare_exchange_n(&all_stats, &thread_stats->next, thread_stats, true,
+                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+    return thread_stats;
+}
+
+/* the SLOWEST_SIZE slowest of both lists, slowest first */
+int merge_slowest(SlowDir *out, SlowDir *a, int a_top, SlowDir *b, int b_top) {
+    int i = 0, j = 0, top = 0;
+    while(top < SLOWEST_SIZE && (i < a_top || j < b_top)) {
+        if(j == b_top || (i < a_top && a[i].ns >= b[j].ns)) {
+            out[top++] = a[i++];
+        } else {
+            out[top++] = b[j++];
+        }
+    }
+    return top;
+}
+
+void print_json_str(const char *str) {
+    fputc('"', stderr);
+    for(; *str; str++) {
+        unsigned char c = *str;
+        if(c == '"' || c == '\\') {
+            fprintf(stderr, "\\%c", c);
+        } else if(c < 0x20) {
+            fprintf(stderr, "\\u%04x", c);
+        } else {
+            fputc(c, stderr);
+        }
+    }
+    fputc('"', stderr);
+}
+
+/* "0", "1", "2-3", ... for bucket i */
+void bucket_name(char *buf, int i) {
+    if(i < 2) {
+        sprintf(buf, "%d", i);
+    } else if(i == HIST_SIZE - 1) {
+        sprintf(buf, "%llu+", 1ULL << (i - 1));
+    } else {
+        sprintf(buf, "%llu-%llu", 1ULL << (i - 1), (1ULL << i) - 1);
+    }
+}
+
+
+/* public function */
+void enable_stats() {
+    stats_enabled = true;
+    start_ns = now_ns();
+}
+
+/* 0 while --stats is off, so a disabled run never reads the clock */
+uint64_t phase_start() {
+    return stats_enabled ? now_ns() : 0;
+}
+
+void phase_end(int phase, uint64_t start) {
+    if(stats_enabled) {
+        my_stats()->phase_ns[phase] += now_ns() - start;
+    }
+}
+
+void count_call(int call, int n) {
+    if(stats_enabled) {
+        my_stats()->calls[call] += n;
+    }
+}
+
+/*
+    one directory enumerated since start. return how long it took if it is
+    among the slowest this thread has seen, the caller then names it with
+    add_slow_dir, 0 otherwise.
+*/
+uint64_t count_dir(uint64_t entries, int depth, uint64_t start) {
+    if(!stats_enabled) {
+        return 0;
+    }
+    Stats *stats = my_stats();
+    uint64_t ns = now_ns() - start;
+    int bucket = 0;
+    while(bucket < HIST_SIZE - 1 && entries >= (1ULL << bucket)) {
+        bucket++;
+    }
+    stats->hist[bucket]++;
+    stats->dirs++;
+    if(depth > stats->max_depth) {
+        stats->max_depth = depth;
+    }
+    if(stats->slowest_top == SLOWEST_SIZE && ns <= stats->slowest[SLOWEST_SIZE - 1].ns) {
+        return 0;
+    }
+    return ns;
+}
+
+void add_slow_dir(const char *path, uint64_t ns) {
+    Stats *stats = my_stats();
+    int i = stats->slowest_top;
+    if(i == SLOWEST_SIZE) {
+        free(stats->slowest[--i].path);
+    } else {
+        stats->slowest_top++;
+    }
+    for(; i > 0 && stats->slowest[i - 1].ns < ns; i--) {
+        stats->slowest[i] = stats->slowest[i - 1];
+    }
+    stats->slowest[i] = (SlowDir){ns, strdup(path)};
+}
+
+/* sum every thread's counters and print them to stderr */
+void print_stats(bool json) {
+    Stats total;
+    memset(&total, 0, sizeof(total));
+    for(Stats *stats = __atomic_load_n(&all_stats, __ATOMIC_ACQUIRE); stats; stats = stats->next) {
+        for(int i = 0; i < PHASE_COUNT; i++) {
+            total.phase_ns[i] += stats->phase_ns[i];
+        }
+        for(int i = 0; i < CALL_COUNT; i++) {
+            total.calls[i] += stats->calls[i];
+        }
+        for(int i = 0; i < HIST_SIZE; i++) {
+            total.hist[i] += stats->hist[i];
+        }
+        total.dirs += stats->dirs;
+        if(stats->max_depth > total.max_depth) {
+            total.max_depth = stats->max_depth;
+        }
+        SlowDir merged[SLOWEST_SIZE];
+        total.slowest_top = merge_slowest(merged, total.slowest, total.slowest_top,
+                                          stats->slowest, stats->slowest_top);
+        memcpy(total.slowest, merged, sizeof(merged));
+    }
+    double wall_ms = (now_ns() - start_ns) / 1e6;
+    char name[32];
+
+    if(json) {
+        fprintf(stderr, "{\"wall_ms\": %.3f, \"phase_ms\": {", wall_ms);
+        for(int i = 0; i < PHASE_COUNT; i++) {
+            fprintf(stderr, "%s\"%s\": %.3f", i ? ", " : "", phase_names[i], total.phase_ns[i] / 1e6);
+        }
+        fprintf(stderr, "}, \"syscalls\": {");
+        for(int i = 0; i < CALL_COUNT; i++) {
+            fprintf(stderr, "%s\"%s\": %llu", i ? ", " : "", call_names[i],
+                    (unsigned long long)total.calls[i]);
+        }
+        fprintf(stderr, "}, \"directories\": %llu, \"max_depth\": %d, \"entries_histogram\": {",
+                (unsigned long long)total.dirs, total.max_depth);
+        for(int i = 0; i < HIST_SIZE; i++) {
+            bucket_name(name, i);
+            fprintf(stderr, "%s\"%s\": %llu", i ? ", " : "", name, (unsigned long long)total.hist[i]);
+        }
+        fprintf(stderr, "}, \"slowest\": [");
+        for(int i = 0; i < total.slowest_top; i++) {
+            fprintf(stderr, "%s{\"path\": ", i ? ", " : "");
+            print_json_str(total.slowest[i].path);
+            fprintf(stderr, ", \"ms\": %.3f}", total.slowest[i].ns / 1e6);
+        }
+        fprintf(stderr, "]}\n");
+        return;
+    }
+
+    fprintf(stderr, "\nwall time %.3f ms, phases summed over threads:\n", wall_ms);
+    for(int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(stderr, "  %-16s %12.3f ms\n", phase_names[i], total.phase_ns[i] / 1e6);
+    }
+    fprintf(stderr, "syscalls:\n");
+    for(int i = 0; i < CALL_COUNT; i++) {
+        if(total.calls[i]) {
+            fprintf(stderr, "  %-16s %12llu\n", call_names[i], (unsigned long long)total.calls[i]);
+        }
+    }
+    fprintf(stderr, "%llu directories, max depth %d, entries per directory:\n",
+            (unsigned long long)total.dirs, total.max_depth);
+    for(int i = 0; i < HIST_SIZE; i++) {
+        if(total.hist[i]) {
+            bucket_name(name, i);
+            fprintf(stderr, "  %-16s %12llu\n", name, (unsigned long long)total.hist[i]);
+        }
+    }
+    fprintf(stderr, "slowest directories:\n");
+    for(int i = 0; i < total.slowest_top; i++) {
+        fprintf(stderr, "  %12.3f ms  %s\n", total.slowest[i].ns / 1e6, total.slowest[i].path);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* where the time goes, summed over every thread */
+enum Phase {
+    PHASE_OPEN,
+    PHASE_READDIR,
+    PHASE_STAT,
+    PHASE_READLINK,
+    PHASE_SORT,
+    PHASE_CACHE,
+    PHASE_OUTPUT,
+    PHASE_COUNT
+};
+
+/* syscalls issued, statx done through io_uring are counted apart */
+enum Call {
+    CALL_OPENAT,
+    CALL_CLOSE,
+    CALL_GETDENTS64,
+    CALL_STATX,
+    CALL_READLINKAT,
+    CALL_WRITE,
+    CALL_PWRITE,
+    CALL_URING_ENTER,
+    CALL_URING_STATX,
+    CALL_COUNT
+};
+
+// directory sizes by power of two: 0, 1, 2-3, 4-7, ...
+#define HIST_SIZE 24
+#define SLOWEST_SIZE 10
+
+typedef struct SlowDir SlowDir;
+struct SlowDir {
+    uint64_t ns;
+    char *path;
+};
+
+/*
+    counters of one thread, only ever written by it. every thread links
+    its own into a list the first time it counts something.
+*/
+typedef struct Stats Stats;
+struct Stats {
+    uint64_t phase_ns[PHASE_COUNT];
+    uint64_t calls[CALL_COUNT];
+    uint64_t hist[HIST_SIZE];
+    uint64_t dirs;
+    int max_depth;
+    // slowest first
+    SlowDir slowest[SLOWEST_SIZE];
+    int slowest_top;
+    Stats *next;
+};
+
+/* --stats, everything below is a no-op while it is false */
+extern bool stats_enabled;
+
+void enable_stats();
+uint64_t phase_start();
+void phase_end(int phase, uint64_t start);
+void count_call(int call, int n);
+uint64_t count_dir(uint64_t entries, int depth, uint64_t start);
+void add_slow_dir(const char *path, uint64_t ns);
+void print_stats(bool json);
+
+#endif
@@ -0,0 +1,81 @@
+#include "top.h"
+
+void swap_top(TopEntry *a, TopEntry *b) {
+    TopEntry tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+void sift_down_top(TopEntry *ent, int top, int i) {
+    while(true) {
+        int min = i, l = 2 * i + 1, r = l + 1;
+        if(l < top && ent[l].size < ent[min].size) {
+            min = l;
+        }
+        if(r < top && ent[r].size < ent[min].size) {
+            min = r;
+        }
+        if(min == i) {
+            return;
+        }
+        swap_top(&ent[i], &ent[min]);
+        i = min;
+    }
+}
+
+
+/* public function */
+void init_top_heap(TopHeap *heap, int n) {
+    heap->n = n;
+    heap->top = 0;
+    heap->ent = malloc(sizeof(TopEntry) * n);
+    if(!heap->ent) {
+        perror("Memory leak!");
+        exit(1);
+    }
+}
+
+/* whether size makes it in, checked before the caller builds the path */
+bool top_wants(TopHeap *heap, uint64_t size) {
+    return heap->top < heap->n || size > heap->ent[0].size;
+}
+
+void push_top_heap(TopHeap *heap, uint64_t size, const char *path) {
+    char *copy = strdup(path);
+    if(!copy) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    if(heap->top < heap->n) {
+        // sift up
+        int i = heap->top++;
+        heap->ent[i] = (TopEntry){size, copy};
+        while(i > 0 && heap->ent[(i - 1) / 2].size > heap->ent[i].size) {
+            swap_top(&heap->ent[(i - 1) / 2], &heap->ent[i]);
+            i = (i - 1) / 2;
+        }
+        return;
+    }
+    // replace the smallest
+    free(heap->ent[0].path);
+    heap->ent[0] = (TopEntry){size, copy};
+    sift_down_top(heap->ent, heap->top, 0);
+}
+
+/* heap sort in place, largest first, return how many there are */
+int sort_top_heap(TopHeap *heap) {
+    for(int top = heap->top - 1; top > 0; top--) {
+        swap_top(&heap->ent[0], &heap->ent[top]);
+        sift_down_top(heap->ent, top, 0);
+    }
+    return heap->top;
+}
+
+void free_top_heap(TopHeap *heap) {
+    for(int i = 0; i < heap->top; i++) {
+        free(heap->ent[i].path);
+    }
+    free(heap->ent);
+    heap->ent = NULL;
+    heap->top = 0;
+}
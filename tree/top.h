@@ -0,0 +1,32 @@
+#ifndef _TOP_H
+#define _TOP_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+typedef struct TopEntry TopEntry;
+struct TopEntry {
+    uint64_t size;
+    char *path;
+};
+
+/*
+    --top: the n largest sizes offered so far, a min heap so the smallest
+    of them is the one to beat. memory stays O(n) whatever the tree size.
+*/
+typedef struct TopHeap TopHeap;
+struct TopHeap {
+    int n, top;
+    TopEntry *ent;
+};
+
+void init_top_heap(TopHeap *heap, int n);
+bool top_wants(TopHeap *heap, uint64_t size);
+void push_top_heap(TopHeap *heap, uint64_t size, const char *path);
+int sort_top_heap(TopHeap *heap);
+void free_top_heap(TopHeap *heap);
+
+#endif
@@ -1,122 +1,286 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
-#include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <locale.h>
 
-#define INIT_DEPTH 2
+#include "libtree.h"
+#include "output.h"
+#include "backend.h"
+#include "hashset.h"
+#include "sort.h"
+#include "format.h"
+#include "stats.h"
+#include "diff.h"
+#include "top.h"
 
 int SKIP_HIDDEN = 1;
+/* number of walker threads, 1 = walk in the main thread */
+int JOBS = 1;
+/* how every directory gets stat'ed, see backend.h */
+int BACKEND = BACKEND_SYNC;
+/* index of the previous run, NULL = no cache */
+char *CACHE_PATH = NULL;
+/* keep redrawing from inotify events */
+bool WATCH = false;
+/* print apparent size and disk usage of every node, directories sum up their sub tree */
+bool DU = false;
+/* order of every listing, see sort.h */
+int SORT = SORT_NAME;
+/* colour names, --color=auto turns it off when stdout is not a tty */
+bool COLOR = true;
+/* tree drawing or one record per entry, see format.h */
+int FORMAT = FORMAT_TREE;
+/* -L, levels printed below "." */
+int MAX_DEPTH = INT_MAX;
+/* -P keeps only files matching, -I drops files and directories matching, '|' separated */
+char *INCLUDE = NULL;
+char *EXCLUDE = NULL;
+/* hide directories with nothing left to print below them */
+bool PRUNE = false;
+/* print timings and counters to stderr at exit, as JSON with --stats=json */
+bool STATS = false;
+bool STATS_JSON = false;
+/* bytes a listing may take before it is spilled to sorted runs, 0 = no limit */
+size_t MEM_LIMIT = 0;
+/* -l follows symlinks to directories, each directory is listed once that way */
+bool FOLLOW_LINKS = false;
+/* -x stays on the file system of "." */
+bool ONE_FILE_SYSTEM = false;
+/* --top, how many of the largest files and directories to list at the end */
+int TOP_N = 0;
+/* --snapshot writes the walk there as --format=binary */
+char *SNAPSHOT_PATH = NULL;
+/* --diff old new, each a snapshot or a directory to walk */
+char *DIFF_OLD = NULL;
+char *DIFF_NEW = NULL;
+/* what statx asks for on top of type, mode and size, grows with --du and --format */
+unsigned int STAT_MASK = 0;
 
 /* statistics var */
-int TOTAL_SIZE = 0;
+long long TOTAL_SIZE = 0;
+long long TOTAL_DISK = 0;
 int DIR_NUM = 0;
 int FILE_NUM = 0;
 int SOFT_LINK_NUM = 0;
 
-/* recursive var */
-int is_last_size = INIT_DEPTH;
-bool *is_last;
-
-/* path list */
-typedef struct PathList PathList;
-struct PathList {
-    // capacity = path memory size
-    // size = the number of path
-    int capacity, top;
-    char **path;
+/* --du */
+#define DU_FIELD_WIDTH 17
+
+typedef struct DuSize DuSize;
+struct DuSize {
+    // apparent size and allocated bytes
+    long long size, disk;
+};
+
+/* a directory being printed, its size is only known once its listing is done */
+typedef struct DuFrame DuFrame;
+struct DuFrame {
+    DuSize total;
+    // reserved for the size field, -1 for the root
+    off_t du_pos;
 };
 
-PathList *new_path_list() {
-    PathList *result = calloc(1, sizeof(PathList));
-    // init size is 16
-    result->capacity = 16;
-    result->path = calloc(1, sizeof(char*) * 16);
+// every inode with more than one link that was already counted
+HashSet du_seen;
+// frame of a directory at depth d is du_stack[d + 1], the root is at depth -1
+DuFrame *du_stack = NULL;
+int du_stack_size = 0;
+// --top, directories by the size of their whole sub tree
+TopHeap top_files, top_dirs;
+
+/* what ent adds to its directory, hard links count only the first time */
+DuSize du_entry(const TreeEntry *ent) {
+    DuSize result = {0, 0};
+    if(!S_ISDIR(ent->mode) && ent->nlink > 1 && !insert_hash_set(&du_seen, ent->dev, ent->ino)) {
+        return result;
+    }
+    result.size = ent->size;
+    result.disk = ent->blocks * 512;
     return result;
 }
 
-void append_path_list(PathList *cur_list, char *path) {
-    // realloc
-    if(cur_list->capacity < cur_list->top + 1) {
-        cur_list->capacity <<= 1;
-        char **new_ptr = realloc(cur_list->path, sizeof(char*) * cur_list->capacity);
-        if(new_ptr == NULL) {
-            printf("realloc error\n");
+DuFrame *du_frame(int idx) {
+    if(idx >= du_stack_size) {
+        int new_size = du_stack_size ? du_stack_size * 2 : 16;
+        while(idx >= new_size) {
+            new_size *= 2;
+        }
+        DuFrame *new_ptr = realloc(du_stack, sizeof(DuFrame) * new_size);
+        if(!new_ptr) {
+            perror("Memory leak!");
             exit(1);
-        };
-        cur_list->path = new_ptr;
-    }
-    // warning: don't forget '\0'
-    int path_len = strlen(path);
-    char *copy_path = calloc(1, sizeof(char) * (path_len + 1));
-    strncpy(copy_path, path, path_len);
-    cur_list->path[cur_list->top++] = copy_path;
-}
-
-int cmp(const void *a, const void *b) {
-    return strcmp(*(char **)a, *(char **)b);
-}
-
-PathList *sort(char *path) {
-    PathList *result = new_path_list();
-    // get all file name
-    DIR *d = opendir(path);
-    if(d) {
-        struct dirent *cur_dir = readdir(d);
-        while ((cur_dir = readdir(d)) != NULL) {
-            // skip hidden file
-            if(SKIP_HIDDEN && cur_dir->d_name[0] == '.') {
-                continue;
-            }
-            append_path_list(result, cur_dir->d_name);
         }
+        du_stack = new_ptr;
+        du_stack_size = new_size;
     }
-    // warning: don't forget to closedir! Or you will not be able to open folder.
-    closedir(d);
-    qsort(result->path, result->top, sizeof(result->path[0]), cmp);
-    return result;
+    return &du_stack[idx];
 }
 
-void print(char *name, int depth, mode_t file_type) {
-    // print prefix
-    for(int i = 0; i < depth; i++) {
-        if(is_last[i]) {
-            printf("    ");
-        } else {
-            printf("│   ");
-        }
+/* at most 5 chars: 1023, 4.0K, 12M */
+void human_size(char *buf, long long size) {
+    const char *unit = "BKMGTPE";
+    double value = size;
+    int i = 0;
+    while(value >= 1024 && unit[i + 1]) {
+        value /= 1024;
+        i++;
     }
-    if(is_last[depth]) {
-        printf("└── ");
+    if(i == 0) {
+        sprintf(buf, "%lld", size);
+    } else if(value < 10) {
+        sprintf(buf, "%.1f%c", value, unit[i]);
     } else {
-        printf("├── ");
+        sprintf(buf, "%.0f%c", value, unit[i]);
+    }
+}
+
+/* "[  4.0K   8.0K]  ", always DU_FIELD_WIDTH bytes */
+void du_field(char *buf, DuSize du) {
+    char size[16], disk[16];
+    human_size(size, du.size);
+    human_size(disk, du.disk);
+    snprintf(buf, DU_FIELD_WIDTH + 1, "[%6.6s %6.6s]  ", size, disk);
+}
+
+/* du = NULL prints no size, an entry whose listing follows only reserves room for it */
+off_t print(const char *name, bool last, mode_t file_type, DuSize *du, bool follow) {
+    // print prefix
+    out_prefix();
+    if(last) {
+        out_str("└── ");
+    } else {
+        out_str("├── ");
+    }
+    off_t du_pos = -1;
+    if(du && follow) {
+        du_pos = out_reserve(DU_FIELD_WIDTH);
+    } else if(du) {
+        char field[DU_FIELD_WIDTH + 1];
+        du_field(field, *du);
+        out_str(field);
     }
     // choose ansi color
-    if(S_ISDIR(file_type)) {
-        printf("\033[1;96m%s\033[0m", name);
-    } else if(S_ISLNK(file_type)) {
-        printf("\033[1;95m%s\033[0m", name);
-    } else if(access(name, X_OK) == 0) {
-        printf("\033[1;91m%s\033[0m", name);
+    const char *color = NULL;
+    if(COLOR) {
+        if(S_ISDIR(file_type)) {
+            color = COLOR_DIR;
+        } else if(S_ISLNK(file_type)) {
+            color = COLOR_LINK;
+        } else if(file_type & (S_IXUSR | S_IXGRP | S_IXOTH)) {
+            color = COLOR_EXEC;
+        }
+    }
+    if(color) {
+        out_str(color);
+        out_str(name);
+        out_str(COLOR_RESET);
     } else {
-        printf("%s", name);
+        out_str(name);
     }
+    return du_pos;
 }
 
-void print_list(PathList *list, int depth) {
-    /* expand is_last array */
-    if(depth >= is_last_size) {
-        is_last_size *= 2;
-        bool *new_ptr = (bool*)realloc(is_last, sizeof(bool) * is_last_size);
-        if(!new_ptr) {
-            perror("Memory leak!");
-            exit(1);
-        }
-        is_last = new_ptr;
+void count_entry(const TreeEntry *ent) {
+    if(S_ISLNK(ent->mode)) {
+        SOFT_LINK_NUM++;
+    } else if(S_ISREG(ent->mode)) {
+        FILE_NUM++;
+    } else if(S_ISDIR(ent->mode)) {
+        DIR_NUM++;
+    }
+    // calc total size
+    TOTAL_SIZE += ent->size;
+}
+
+void emit_entry(const TreeEntry *ent) {
+    Record rec = {
+        .path = ent->path,
+        .path_len = ent->path_len,
+        .link = ent->link,
+        .mode = ent->mode,
+        .size = ent->size,
+        .ino = ent->ino,
+        .mtime_sec = ent->mtime_sec,
+        .mtime_nsec = ent->mtime_nsec
+    };
+    emit_record(FORMAT, &rec);
+}
+
+/* --top: the path is only put together for the few sizes that make it in */
+void offer_top(const TreeEntry *ent, long long size) {
+    TopHeap *heap = S_ISDIR(ent->mode) ? &top_dirs : S_ISREG(ent->mode) ? &top_files : NULL;
+    if(!heap || !top_wants(heap, size)) {
+        return;
+    }
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "./%s", ent->path);
+    push_top_heap(heap, size, path);
+}
+
+void print_top(const char *what, TopHeap *heap) {
+    char size[16];
+    int n = sort_top_heap(heap);
+    out_printf("\nlargest %s:\n", what);
+    for(int i = 0; i < n; i++) {
+        human_size(size, heap->ent[i].size);
+        out_printf("%6s  ", size);
+        out_str(heap->ent[i].path);
+        out_char('\n');
     }
+    free_top_heap(heap);
+}
 
+void print_summary() {
+    out_printf("\n%d directories, %d files, %d soft links\n", DIR_NUM, FILE_NUM, SOFT_LINK_NUM);
+    out_printf("size: %lld\n", TOTAL_SIZE);
+    if(DU) {
+        out_printf("disk usage: %lld\n", TOTAL_DISK);
+    }
+    if(TOP_N) {
+        print_top("files", &top_files);
+        print_top("directories", &top_dirs);
+    }
+}
+
+/* visitor, the root starts a new frame of --watch */
+void begin_dir(void *arg, const TreeEntry *dir) {
+    (void)arg;
+    if(dir->depth >= 0) {
+        push_prefix(dir->last);
+        return;
+    }
+    DIR_NUM = FILE_NUM = SOFT_LINK_NUM = 0;
+    TOTAL_SIZE = TOTAL_DISK = 0;
+    if(dir->count) {
+        // --watch, the model keeps them, a redraw doesn't count again
+        DIR_NUM = dir->count->dirs;
+        FILE_NUM = dir->count->files;
+        SOFT_LINK_NUM = dir->count->links;
+        TOTAL_SIZE = dir->count->size;
+    }
+    du_frame(0)->total = (DuSize){0, 0};
+    if(WATCH) {
+        // clear the screen and go home
+        out_str("\033[H\033[2J");
+    }
+    if(FORMAT == FORMAT_TREE) {
+        out_str(".\n");
+    } else {
+        begin_records(FORMAT);
+    }
+}
+
+/* print one entry, a record per entry is written before descending so nothing is held back */
+void print_entry(void *arg, const TreeEntry *ent) {
     /*
         S_IFMT: type of file
         S_IFBLK: block special
@@ -126,45 +290,434 @@ void print_list(PathList *list, int depth) {
         S_IFDIR: directory
         S_IFLNK: symbolic link
     */
-    struct stat buf;
-    for(int i = 0; i < list->top; i++) {
-        // update is last array
-        if(i == list->top - 1) {
-            is_last[depth] = true;
+    (void)arg;
+    DuSize own = {0, 0};
+    if(DU || TOP_N) {
+        own = du_entry(ent);
+    }
+    if(!WATCH) {
+        count_entry(ent);
+    }
+    off_t du_pos = -1;
+    if(FORMAT != FORMAT_TREE) {
+        emit_entry(ent);
+    } else {
+        du_pos = print(ent->name, ent->last, ent->mode, DU ? &own : NULL, ent->descend);
+        if(S_ISLNK(ent->mode)) {
+            out_str(" -> ");
+            out_str(ent->link);
+            if(ent->cycle) {
+                out_str("  [recursive, not followed]");
+            }
+            out_char('\n');
+        } else if(S_ISREG(ent->mode) || S_ISDIR(ent->mode)) {
+            out_char('\n');
         }
-        // print and calc
-        lstat(list->path[i], &buf);
-
-        print(list->path[i], depth, buf.st_mode);
-        if(S_ISLNK(buf.st_mode)) {
-            char ori_path[500];
-            readlink(list->path[i], ori_path, sizeof(ori_path));
-            SOFT_LINK_NUM += 1;
-            printf(" -> %s\n", ori_path);
-        } else if(S_ISREG(buf.st_mode)) {
-            FILE_NUM += 1;
-            printf("\n");
-        } else if(S_ISDIR(buf.st_mode)) {
-            DIR_NUM += 1;
-            printf("\n");
-            PathList *new_path_list = sort(list->path[i]);
-            // recursive
-            chdir(list->path[i]);
-            print_list(new_path_list, depth + 1);
-            chdir("..");
+    }
+    if(!DU && !TOP_N) {
+        return;
+    }
+    if(ent->descend) {
+        // end_dir adds it up once the listing is done
+        DuFrame *frame = du_frame(ent->depth + 1);
+        frame->total = own;
+        frame->du_pos = du_pos;
+        return;
+    }
+    DuFrame *parent = du_frame(ent->depth);
+    parent->total.size += own.size;
+    parent->total.disk += own.disk;
+    if(TOP_N) {
+        offer_top(ent, own.size);
+    }
+}
+
+/* visitor, the root ends the walk or the frame of --watch */
+void end_dir(void *arg, const TreeEntry *dir) {
+    (void)arg;
+    if(dir->depth < 0) {
+        if(DU) {
+            // hard links were counted once
+            TOTAL_SIZE = du_stack[0].total.size;
+            TOTAL_DISK = du_stack[0].total.disk;
         }
-        // calc total size
-        TOTAL_SIZE += buf.st_size;
+        if(FORMAT == FORMAT_TREE) {
+            print_summary();
+        } else {
+            end_records(FORMAT);
+        }
+        out_flush();
+        return;
+    }
+    pop_prefix();
+    if(!DU && !TOP_N) {
+        return;
+    }
+    DuFrame *frame = &du_stack[dir->depth + 1], *parent = &du_stack[dir->depth];
+    if(DU) {
+        char field[DU_FIELD_WIDTH + 1];
+        du_field(field, frame->total);
+        out_patch(frame->du_pos, field, DU_FIELD_WIDTH);
+    }
+    if(TOP_N) {
+        offer_top(dir, frame->total.size);
+    }
+    parent->total.size += frame->total.size;
+    parent->total.disk += frame->total.disk;
+}
+
+/* walk root and print it, the options are all set by now */
+void walk_tree(const char *root) {
+    TreeOptions opt;
+    default_tree_options(&opt);
+    opt.jobs = JOBS;
+    opt.backend = BACKEND;
+    opt.sort = SORT;
+    opt.skip_hidden = SKIP_HIDDEN;
+    opt.max_depth = MAX_DEPTH;
+    opt.include = INCLUDE;
+    opt.exclude = EXCLUDE;
+    opt.prune = PRUNE;
+    opt.follow_links = FOLLOW_LINKS;
+    opt.one_file_system = ONE_FILE_SYSTEM;
+    opt.mem_limit = MEM_LIMIT;
+    opt.cache_path = CACHE_PATH;
+    opt.stat_mask = STAT_MASK;
+
+    TreeWalk *walk = new_tree_walk(&opt);
+    if(!walk) {
+        perror("my_tree");
+        exit(1);
     }
-    // clear is_last array
-    is_last[depth] = false;
+    TreeVisitor visitor = {begin_dir, print_entry, end_dir, NULL};
+    if(WATCH ? !watch_tree_walk(walk, root, &visitor) : !run_tree_walk(walk, root, &visitor)) {
+        perror(root);
+        exit(1);
+    }
+    free_tree_walk(walk);
+    if(STATS) {
+        print_stats(STATS_JSON);
+    }
+}
+
+/* -P and -I may be given more than once, every list is kept */
+char *join_patterns(char *list, const char *patterns) {
+    size_t len = list ? strlen(list) : 0;
+    char *result = realloc(list, len + strlen(patterns) + 2);
+    if(!result) {
+        perror("Memory leak!");
+        exit(1);
+    }
+    if(len) {
+        result[len++] = '|';
+    }
+    strcpy(result + len, patterns);
+    return result;
 }
 
-int main() {
-    is_last = calloc(1, sizeof(bool) * INIT_DEPTH);
-    printf(".\n");
-    PathList *list = sort(".");
-    print_list(list, 0);
-    printf("\n%d directories, %d files, %d soft links\n", DIR_NUM, FILE_NUM, SOFT_LINK_NUM);
-    printf("size: %d\n", TOTAL_SIZE);
-}
\ No newline at end of file
+/* --diff: a snapshot is read as is, a directory is walked by a child into a pipe */
+void open_tree_records(RecordReader *reader, const char *path, pid_t *pid) {
+    struct stat st;
+    FILE *file;
+    if(stat(path, &st) != 0) {
+        perror(path);
+        exit(2);
+    }
+    if(S_ISDIR(st.st_mode)) {
+        int pipe_fd[2];
+        if(pipe(pipe_fd) != 0) {
+            perror("pipe");
+            exit(2);
+        }
+        *pid = fork();
+        if(*pid < 0) {
+            perror("fork");
+            exit(2);
+        }
+        if(*pid == 0) {
+            close(pipe_fd[0]);
+            dup2(pipe_fd[1], STDOUT_FILENO);
+            close(pipe_fd[1]);
+            walk_tree(path);
+            // not exit: stdio would seek a snapshot FILE inherited from the parent
+            // back to where its buffer ends, and the parent reads it through that offset
+            out_flush();
+            _exit(0);
+        }
+        close(pipe_fd[1]);
+        file = fdopen(pipe_fd[0], "r");
+    } else {
+        file = fopen(path, "r");
+    }
+    if(!file) {
+        perror(path);
+        exit(2);
+    }
+    if(!begin_read_records(reader, file)) {
+        fprintf(stderr, "my_tree: %s: not a snapshot or a directory\n", path);
+        exit(2);
+    }
+}
+
+/* exit status of diff(1): 0 same, 1 different, 2 trouble */
+int diff_trees(const char *old_path, const char *new_path) {
+    RecordReader old, new;
+    pid_t pid[2] = {-1, -1};
+    open_tree_records(&old, old_path, &pid[0]);
+    open_tree_records(&new, new_path, &pid[1]);
+    DiffCount count = diff_records(&old, &new, COLOR);
+    out_printf("\n%lld added, %lld removed, %lld modified\n",
+               count.added, count.removed, count.modified);
+    out_flush();
+    end_read_records(&old);
+    end_read_records(&new);
+    int result = count.added || count.removed || count.modified;
+    for(int i = 0; i < 2; i++) {
+        int status;
+        if(pid[i] > 0 && (waitpid(pid[i], &status, 0) < 0 || !WIFEXITED(status) ||
+                          WEXITSTATUS(status) != 0)) {
+            result = 2;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    static struct option long_options[] = {
+        {"color", required_argument, NULL, 'c'},
+        {"backend", required_argument, NULL, 'b'},
+        {"cache", required_argument, NULL, 'i'},
+        {"watch", no_argument, NULL, 'w'},
+        {"du", no_argument, NULL, 'd'},
+        {"sort", required_argument, NULL, 's'},
+        {"unsorted", no_argument, NULL, 'U'},
+        {"format", required_argument, NULL, 'f'},
+        {"prune", no_argument, NULL, 'p'},
+        {"stats", optional_argument, NULL, 'S'},
+        {"mem-limit", required_argument, NULL, 'm'},
+        {"one-file-system", no_argument, NULL, 'x'},
+        {"snapshot", required_argument, NULL, 'o'},
+        {"diff", required_argument, NULL, 'D'},
+        {"top", required_argument, NULL, 't'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while((opt = getopt_long(argc, argv, "j:nlxUL:P:I:", long_options, NULL)) != -1) {
+        switch(opt) {
+            case 'j':
+                JOBS = atoi(optarg);
+                if(JOBS < 1) {
+                    fprintf(stderr, "my_tree: invalid job count: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'n':
+                COLOR = false;
+                break;
+            case 'l':
+                FOLLOW_LINKS = true;
+                break;
+            case 'x':
+                ONE_FILE_SYSTEM = true;
+                break;
+            case 'c':
+                if(strcmp(optarg, "always") == 0) {
+                    COLOR = true;
+                } else if(strcmp(optarg, "never") == 0) {
+                    COLOR = false;
+                } else if(strcmp(optarg, "auto") == 0) {
+                    COLOR = isatty(STDOUT_FILENO);
+                } else {
+                    fprintf(stderr, "my_tree: invalid color mode: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'b':
+                if(strcmp(optarg, "sync") == 0) {
+                    BACKEND = BACKEND_SYNC;
+                } else if(strcmp(optarg, "threads") == 0) {
+                    BACKEND = BACKEND_THREADS;
+                } else if(strcmp(optarg, "uring") == 0) {
+                    BACKEND = BACKEND_URING;
+                } else {
+                    fprintf(stderr, "my_tree: invalid backend: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'i':
+                CACHE_PATH = optarg;
+                break;
+            case 'w':
+                WATCH = true;
+                break;
+            case 'd':
+                DU = true;
+                break;
+            case 's':
+                if(strcmp(optarg, "name") == 0) {
+                    SORT = SORT_NAME;
+                } else if(strcmp(optarg, "locale") == 0) {
+                    SORT = SORT_LOCALE;
+                } else if(strcmp(optarg, "none") == 0) {
+                    SORT = SORT_NONE;
+                } else {
+                    fprintf(stderr, "my_tree: invalid sort mode: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'U':
+                SORT = SORT_NONE;
+                break;
+            case 'L':
+                MAX_DEPTH = atoi(optarg);
+                if(MAX_DEPTH < 1) {
+                    fprintf(stderr, "my_tree: invalid level: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'P':
+                INCLUDE = join_patterns(INCLUDE, optarg);
+                break;
+            case 'I':
+                EXCLUDE = join_patterns(EXCLUDE, optarg);
+                break;
+            case 'p':
+                PRUNE = true;
+                break;
+            case 'm': {
+                char *end;
+                unsigned long long size = strtoull(optarg, &end, 10);
+                int shift = *end == 'K' ? 10 : *end == 'M' ? 20 : *end == 'G' ? 30 : 0;
+                if(shift) {
+                    end++;
+                }
+                MEM_LIMIT = size << shift;
+                if(*end || MEM_LIMIT < MIN_MEM_LIMIT) {
+                    fprintf(stderr, "my_tree: invalid memory limit: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            }
+            case 't':
+                TOP_N = atoi(optarg);
+                if(TOP_N < 1) {
+                    fprintf(stderr, "my_tree: invalid top count: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'o':
+                SNAPSHOT_PATH = optarg;
+                break;
+            case 'D':
+                DIFF_OLD = optarg;
+                break;
+            case 'S':
+                STATS = true;
+                if(optarg && strcmp(optarg, "json") == 0) {
+                    STATS_JSON = true;
+                } else if(optarg && strcmp(optarg, "text") != 0) {
+                    fprintf(stderr, "my_tree: invalid stats format: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'f':
+                if(strcmp(optarg, "tree") == 0) {
+                    FORMAT = FORMAT_TREE;
+                } else if(strcmp(optarg, "ndjson") == 0) {
+                    FORMAT = FORMAT_NDJSON;
+                } else if(strcmp(optarg, "json") == 0) {
+                    FORMAT = FORMAT_JSON;
+                } else if(strcmp(optarg, "binary") == 0) {
+                    FORMAT = FORMAT_BINARY;
+                } else {
+                    fprintf(stderr, "my_tree: invalid format: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-j jobs] [-n] [-l] [-x] [-L level] [-P pattern] [-I pattern] [--prune]"
+                                " [--color=always|never|auto]"
+                                " [--backend=sync|threads|uring] [--cache=index] [--watch] [--du]"
+                                " [--sort=name|locale|none] [-U] [--format=tree|ndjson|json|binary]"
+                                " [--stats[=text|json]] [--mem-limit=size[K|M|G]]"
+                                " [--snapshot file] [--diff old new] [--top n]\n",
+                        argv[0]);
+                exit(1);
+        }
+    }
+    if(DIFF_OLD) {
+        if(optind != argc - 1) {
+            fprintf(stderr, "my_tree: --diff takes an old and a new tree\n");
+            exit(1);
+        }
+        DIFF_NEW = argv[optind];
+    }
+    if(SNAPSHOT_PATH || DIFF_OLD) {
+        if(DU || WATCH || TOP_N || FORMAT != FORMAT_TREE) {
+            fprintf(stderr, "my_tree: --snapshot and --diff can't be combined with --du, --top, --watch"
+                            " or --format\n");
+            exit(1);
+        }
+        // the diff merge joins walks with siblings in byte order
+        FORMAT = FORMAT_BINARY;
+        SORT = SORT_NAME;
+    }
+    if(DIFF_OLD && (CACHE_PATH || STATS || SNAPSHOT_PATH)) {
+        fprintf(stderr, "my_tree: --diff can't be combined with --cache, --stats or --snapshot\n");
+        exit(1);
+    }
+    if(SORT == SORT_LOCALE) {
+        setlocale(LC_COLLATE, "");
+    }
+    if(DU && WATCH) {
+        fprintf(stderr, "my_tree: --du can't be combined with --watch\n");
+        exit(1);
+    }
+    if((PRUNE || STATS || FOLLOW_LINKS) && WATCH) {
+        fprintf(stderr, "my_tree: --prune, --stats and -l can't be combined with --watch\n");
+        exit(1);
+    }
+    if(MEM_LIMIT && (JOBS > 1 || PRUNE || WATCH)) {
+        fprintf(stderr, "my_tree: --mem-limit walks in one thread, without --prune or --watch\n");
+        exit(1);
+    }
+    if(STATS) {
+        enable_stats();
+    }
+    if(FORMAT != FORMAT_TREE && (DU || WATCH || TOP_N)) {
+        fprintf(stderr, "my_tree: --du, --top and --watch only work with the tree format\n");
+        exit(1);
+    }
+    if(TOP_N && WATCH) {
+        fprintf(stderr, "my_tree: --top can't be combined with --watch\n");
+        exit(1);
+    }
+    if(TOP_N) {
+        init_top_heap(&top_files, TOP_N);
+        init_top_heap(&top_dirs, TOP_N);
+    }
+    if(DU) {
+        STAT_MASK |= STATX_BLOCKS | STATX_NLINK | STATX_INO;
+    }
+    if(TOP_N) {
+        // hard links count once, like --du
+        STAT_MASK |= STATX_NLINK | STATX_INO;
+    }
+    if(FORMAT != FORMAT_TREE) {
+        STAT_MASK |= STATX_MTIME | STATX_INO;
+    }
+
+    if(SNAPSHOT_PATH) {
+        int fd = open(SNAPSHOT_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0) {
+            perror(SNAPSHOT_PATH);
+            exit(1);
+        }
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+    if(DIFF_OLD) {
+        exit(diff_trees(DIFF_OLD, DIFF_NEW));
+    }
+    walk_tree(".");
+}